@@ -0,0 +1,262 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "skiplist_rank.hpp"
+
+namespace util {
+
+namespace concurrent_rank {
+
+/*
+ * leaderboard for many writer threads
+ * - elements are sharded by key hash, every shard is a skiplist_rank
+ *   container behind its own shared_mutex: insert / erase lock one shard,
+ *   writers on different shards never wait for each other
+ * - readers shared-lock every shard in index order, so rank / range see one
+ *   consistent cut; they only block writers for the read itself
+ * - rank: 1 + sum of count_less over shards, O(shards * log n)
+ * - range(l, r): k-way merge of per shard cursors, walks r entries in total
+ *   and copies only [l, r], so it suits top-n style queries rather than
+ *   deep pages; range_by_score merges the same cursors from the first score
+ *   not below min
+ */
+template <class score_tt, class element_key_tt, std::size_t shard_count_vv = 16,
+          class hash_tt = std::hash<std::decay_t<element_key_tt>>,
+          class score_compare_tt = std::less<std::decay_t<score_tt>>,
+          class key_compare_tt = std::less<std::decay_t<element_key_tt>>>
+class container {
+  static_assert(shard_count_vv > 0, "at least one shard");
+
+ public:
+  using score_type = std::decay_t<score_tt>;
+  using element_key_type = std::decay_t<element_key_tt>;
+  using list_type = skiplist_rank::container<score_type, element_key_type,
+                                             score_compare_tt, key_compare_tt>;
+  using rank_type = typename list_type::rank_type;
+  using cursor = typename list_type::cursor;
+  using entry = std::pair<score_type, element_key_type>;
+
+  static constexpr rank_type not_exist_rank = list_type::not_exist_rank;
+
+ private:
+  struct alignas(64) shard {
+    mutable std::shared_mutex mut;
+    list_type list;
+  };
+
+  using read_locks =
+      std::array<std::shared_lock<std::shared_mutex>, shard_count_vv>;
+
+ private:
+  std::array<shard, shard_count_vv> _shards;
+
+ private:
+  static bool less(const score_type& ak, const element_key_type& aek,
+                   const score_type& bk, const element_key_type& bek) {
+    if (score_compare_tt{}(ak, bk))
+      return true;
+    if (score_compare_tt{}(bk, ak))
+      return false;
+    return key_compare_tt{}(aek, bek);
+  }
+
+  static std::size_t shard_index(const element_key_type& ek) {
+    // mix the hash, std::hash of integers is identity on most stdlib
+    const uint64_t h =
+        static_cast<uint64_t>(hash_tt{}(ek)) * 0x9e3779b97f4a7c15ull;
+    return (h >> 32) % shard_count_vv;
+  }
+
+  shard& shard_of(const element_key_type& ek) {
+    return _shards[shard_index(ek)];
+  }
+
+  const shard& shard_of(const element_key_type& ek) const {
+    return _shards[shard_index(ek)];
+  }
+
+  read_locks lock_all() const {
+    read_locks locks;
+    for (std::size_t i = 0; i < shard_count_vv; ++i) {
+      locks[i] = std::shared_lock<std::shared_mutex>(_shards[i].mut);
+    }
+    return locks;
+  }
+
+  // k-way merge of ascending shard cursors, caller holds the read locks
+  // fn(const cursor& head) -> bool, false stops the merge
+  template <class fn_tt>
+  static void merge(std::vector<cursor>& heads, fn_tt&& fn) {
+    auto greater = [](const cursor& a, const cursor& b) {
+      return less(b.score(), b.key(), a.score(), a.key());
+    };
+    std::make_heap(heads.begin(), heads.end(), greater);
+    while (!heads.empty()) {
+      std::pop_heap(heads.begin(), heads.end(), greater);
+      auto& head = heads.back();
+      if (!fn(head))
+        return;
+      head.next();
+      if (head) {
+        std::push_heap(heads.begin(), heads.end(), greater);
+      } else {
+        heads.pop_back();
+      }
+    }
+  }
+
+ public:
+  explicit container() = default;
+
+  container(const container&) = delete;
+  container& operator=(const container&) = delete;
+
+ public:
+  // insert or move ek to score
+  [[maybe_unused]] bool insert(const score_type& k,
+                               const element_key_type& ek) {
+    auto& one = shard_of(ek);
+    std::unique_lock<std::shared_mutex> lock(one.mut);
+    return one.list.insert(k, ek);
+  }
+
+  [[maybe_unused]] bool erase(const element_key_type& ek) {
+    auto& one = shard_of(ek);
+    std::unique_lock<std::shared_mutex> lock(one.mut);
+    return one.list.erase(ek);
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    const auto locks = lock_all();
+    std::size_t result = 0;
+    for (const auto& one : _shards) {
+      result += one.list.size();
+    }
+    return result;
+  }
+
+  [[nodiscard]] std::optional<score_type> score(
+      const element_key_type& ek) const {
+    const auto& one = shard_of(ek);
+    std::shared_lock<std::shared_mutex> lock(one.mut);
+    return one.list.score(ek);
+  }
+
+  [[nodiscard]] rank_type rank(const element_key_type& ek) const {
+    const auto locks = lock_all();
+    const auto k = shard_of(ek).list.score(ek);
+    if (!k)
+      return not_exist_rank;
+
+    rank_type result = 1;
+    for (const auto& one : _shards) {
+      result += one.list.count_less(*k, ek);
+    }
+    return result;
+  }
+
+  // ranks [l, r], 1-based, inclusive, ascending
+  std::vector<entry> range(rank_type l, rank_type r) const {
+    if (l == 0)
+      l = 1;
+    if (r < l)
+      return {};
+
+    std::vector<cursor> heads;
+    heads.reserve(shard_count_vv);
+
+    const auto locks = lock_all();
+    std::size_t total = 0;
+    for (const auto& one : _shards) {
+      total += one.list.size();
+      if (auto head = one.list.seek(1)) {
+        heads.push_back(head);
+      }
+    }
+
+    std::vector<entry> result;
+    if (l <= total) {
+      result.reserve(std::min<rank_type>(r, total) - l + 1);
+    }
+    rank_type rank = 0;
+    merge(heads, [&result, &rank, l, r](const cursor& head) {
+      if (++rank >= l) {
+        result.emplace_back(head.score(), head.key());
+      }
+      return rank < r;
+    });
+    return result;
+  }
+
+  // scores in [min, max], ascending
+  std::vector<entry> range_by_score(const score_type& min,
+                                    const score_type& max) const {
+    std::vector<cursor> heads;
+    heads.reserve(shard_count_vv);
+
+    const auto locks = lock_all();
+    for (const auto& one : _shards) {
+      if (auto head = one.list.seek_score(min)) {
+        heads.push_back(head);
+      }
+    }
+
+    std::vector<entry> result;
+    merge(heads, [&result, &max](const cursor& head) {
+      if (score_compare_tt{}(max, head.score()))
+        return false;
+      result.emplace_back(head.score(), head.key());
+      return true;
+    });
+    return result;
+  }
+};
+
+}  // namespace concurrent_rank
+
+}  // namespace util
+
+/* benchmark code
+
+// every thread: 7 score updates : 1 rank query over 1M players
+static void rank_locked_skiplist(benchmark::State &state) {
+  static util::skiplist_rank::container<uint32_t, uint64_t> slr;
+  static std::mutex m;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t uuid = lcg_rand(seed) % 1000000;
+    std::lock_guard<std::mutex> lock(m);
+    if (uuid & 7) {
+      slr.insert(lcg_rand(seed) % 100000, uuid);
+    } else {
+      benchmark::DoNotOptimize(slr.rank(uuid));
+    }
+  }
+}
+
+static void rank_concurrent(benchmark::State &state) {
+  static util::concurrent_rank::container<uint32_t, uint64_t, 32> cr;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t uuid = lcg_rand(seed) % 1000000;
+    if (uuid & 7) {
+      cr.insert(lcg_rand(seed) % 100000, uuid);
+    } else {
+      benchmark::DoNotOptimize(cr.rank(uuid));
+    }
+  }
+}
+
+BENCHMARK(rank_locked_skiplist)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(rank_concurrent)->ThreadRange(1, 32)->UseRealTime();
+
+*/
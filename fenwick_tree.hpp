@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+
+/*
+ * fenwick (binary indexed) tree over [0, size)
+ * - add / prefix / lower_bound are O(log size)
+ * - value_tt is a counter type, prefix sums must be non-decreasing for
+ *   lower_bound (no negative totals)
+ */
+template <class value_tt = uint64_t>
+class fenwick_tree {
+ private:
+  std::vector<value_tt> _tree;  // 1-based
+  std::size_t _high_bit = 0;
+
+ public:
+  explicit fenwick_tree(std::size_t size = 0) { assign(size); }
+
+  void assign(std::size_t size) {
+    _tree.assign(size + 1, value_tt{});
+    _high_bit = 1;
+    while (_high_bit * 2 <= size) {
+      _high_bit *= 2;
+    }
+  }
+
+  // counts[i] for every i, O(size)
+  void build(const std::vector<value_tt>& counts) {
+    assign(counts.size());
+    for (std::size_t i = 1; i < _tree.size(); ++i) {
+      _tree[i] += counts[i - 1];
+      const std::size_t parent = i + (i & (~i + 1));
+      if (parent < _tree.size()) {
+        _tree[parent] += _tree[i];
+      }
+    }
+  }
+
+  [[nodiscard]] std::size_t size() const { return _tree.size() - 1; }
+
+  void add(std::size_t index, value_tt delta) {
+    for (std::size_t i = index + 1; i < _tree.size(); i += i & (~i + 1)) {
+      _tree[i] += delta;
+    }
+  }
+
+  // sum of [0, count)
+  [[nodiscard]] value_tt prefix(std::size_t count) const {
+    value_tt result{};
+    for (std::size_t i = count; i > 0; i -= i & (~i + 1)) {
+      result += _tree[i];
+    }
+    return result;
+  }
+
+  [[nodiscard]] value_tt total() const { return prefix(size()); }
+
+  // value at index
+  [[nodiscard]] value_tt at(std::size_t index) const {
+    return prefix(index + 1) - prefix(index);
+  }
+
+  // smallest index whose prefix(index + 1) > target, size() when none
+  // `target` is reduced to the remainder inside that index
+  std::size_t lower_bound(value_tt& target) const {
+    std::size_t position = 0;
+    for (std::size_t step = _high_bit; step > 0; step /= 2) {
+      const std::size_t next = position + step;
+      if (next < _tree.size() && !(target < _tree[next])) {
+        position = next;
+        target -= _tree[next];
+      }
+    }
+    return position;
+  }
+};
+
+}  // namespace util
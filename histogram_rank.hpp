@@ -0,0 +1,170 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "fenwick_tree.hpp"
+
+namespace util {
+
+namespace histogram_rank {
+
+/*
+ * leaderboard for small integer scores [0, max_score_vv]
+ * eg. tower floor 0-2000, arena points 0-5000
+ * - counts is a fenwick tree over scores, highest score first, so "players
+ *   ahead" is one prefix sum and the n-th player's score one descent
+ * - members[score] holds that score's players, erase swaps with the last
+ * - rank 1 is the highest score, equal scores share a rank
+ * - rank / insert / erase O(log S), memory O(S + n), no balanced tree
+ */
+template <uint32_t max_score_vv, class element_key_tt,
+          class hash_tt = std::hash<std::decay_t<element_key_tt>>>
+class container {
+ public:
+  using score_type = uint32_t;
+  using element_key_type = std::decay_t<element_key_tt>;
+
+  using rank_type = uint64_t;
+  static constexpr rank_type not_exist_rank = 0;
+
+  static constexpr std::size_t score_count = std::size_t(max_score_vv) + 1;
+
+ private:
+  struct location {
+    score_type score = 0;
+    std::size_t position = 0;  // in members[score]
+  };
+
+  using element2location =
+      std::unordered_map<element_key_type, location, hash_tt>;
+
+ private:
+  fenwick_tree<rank_type> counts{score_count};
+  std::vector<std::vector<element_key_type>> members{score_count};
+  element2location e2l;
+
+ private:
+  // fenwick index, highest score first
+  static std::size_t slot(score_type k) { return max_score_vv - k; }
+
+  void unlink(const location& at) {
+    auto& list = members[at.score];
+    if (at.position + 1 != list.size()) {
+      list[at.position] = std::move(list.back());
+      e2l.find(list[at.position])->second.position = at.position;
+    }
+    list.pop_back();
+    counts.add(slot(at.score), rank_type(-1));
+  }
+
+ public:
+  explicit container() = default;
+
+ public:
+  // insert or move ek to score, false when k is out of [0, max_score_vv]
+  [[maybe_unused]] bool insert(score_type k, const element_key_type& ek) {
+    if (k > max_score_vv) {
+      return false;
+    }
+
+    auto [it, inserted] = e2l.try_emplace(ek);
+    if (!inserted) {
+      if (it->second.score == k) {
+        return true;
+      }
+      unlink(it->second);
+    }
+
+    auto& list = members[k];
+    it->second = location{k, list.size()};
+    list.emplace_back(ek);
+    counts.add(slot(k), 1);
+    return true;
+  }
+
+  [[maybe_unused]] bool erase(const element_key_type& ek) {
+    if (const auto it = e2l.find(ek); it != e2l.end()) {
+      const auto at = it->second;
+      e2l.erase(it);
+      unlink(at);
+      return true;
+    }
+    return false;
+  }
+
+  [[nodiscard]] std::size_t size() const { return e2l.size(); }
+
+  // 1 + players with a higher score
+  [[nodiscard]] rank_type rank(const element_key_type& ek) const {
+    if (const auto it = e2l.find(ek); it != e2l.end()) {
+      return 1 + counts.prefix(slot(it->second.score));
+    }
+    return not_exist_rank;
+  }
+
+  // rank of a score that nobody may hold yet, eg. "you would be #12"
+  [[nodiscard]] rank_type rank_of_score(score_type k) const {
+    return 1 + counts.prefix(k > max_score_vv ? 0 : slot(k));
+  }
+
+  [[nodiscard]] std::optional<score_type> score(
+      const element_key_type& ek) const {
+    if (const auto it = e2l.find(ek); it != e2l.end()) {
+      return it->second.score;
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] std::size_t count(score_type k) const {
+    return k > max_score_vv ? 0 : members[k].size();
+  }
+
+  // positions [l, r] (1-based, inclusive), highest score first
+  std::vector<element_key_type> range(rank_type l, rank_type r) const {
+    std::vector<element_key_type> result{};
+    if (l == 0)
+      l = 1;
+    if (r > size())
+      r = size();
+    if (r < l) {
+      return result;
+    }
+
+    result.reserve(r - l + 1);
+    rank_type skip = l - 1;
+    for (auto index = counts.lower_bound(skip); index < score_count; ++index) {
+      const auto& list = members[max_score_vv - index];
+      for (auto i = static_cast<std::size_t>(skip); i < list.size(); ++i) {
+        result.emplace_back(list[i]);
+        if (result.size() > r - l) {
+          return result;
+        }
+      }
+      skip = 0;
+    }
+    return result;
+  }
+};
+
+}  // namespace histogram_rank
+
+}  // namespace util
+
+/* example
+
+util::histogram_rank::container<2000, uint64_t> tower;
+
+tower.insert(35, 10001);
+tower.insert(120, 10002);
+tower.insert(120, 10003);
+
+tower.rank(10002);          // 1
+tower.rank(10001);          // 3
+tower.rank_of_score(100);   // 3
+tower.range(1, 2);          // {10002, 10003}
+
+*/
@@ -1,11 +1,115 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <shared_mutex>
+#include <span>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+
+#include "string_util.h"
 
 namespace easy::lfu {
 
-template <class key_tt, class value_tt, size_t max_size>
+/*
+ * count-min sketch of 4-bit counters (16 per uint64_t word), depth 4
+ * - estimate is the min of the 4 counters, counters saturate at 15
+ * - after sample_size increments every counter is halved, so old popularity
+ *   fades instead of growing forever
+ * - memory is fixed by the capacity passed in, independent of history
+ */
+class frequency_sketch {
+ private:
+  static constexpr uint64_t seeds[4] = {
+      0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull, 0x9ae16a3b2f90404full,
+      0xcbf29ce484222325ull};
+  static constexpr uint64_t reset_mask = 0x7777777777777777ull;
+
+  std::vector<uint64_t> _table;
+  uint64_t _mask = 0;
+  size_t _sample_size = 0;
+  size_t _size = 0;
+
+ private:
+  static uint64_t spread(uint64_t hash) {
+    hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdull;
+    return hash ^ (hash >> 33);
+  }
+
+  size_t index_of(uint64_t hash, size_t depth) const {
+    uint64_t h = (hash + seeds[depth]) * seeds[depth];
+    h += h >> 32;
+    return static_cast<size_t>(h & _mask);
+  }
+
+  // counter (0-15) in the word, different bits of the hash for every depth
+  static unsigned offset_of(uint64_t hash, size_t depth) {
+    return static_cast<unsigned>((hash >> (depth * 4)) & 15) << 2;
+  }
+
+  void reset() {
+    for (auto& word : _table) {
+      word = (word >> 1) & reset_mask;
+    }
+    _size /= 2;
+  }
+
+ public:
+  // capacity: expected number of distinct hot keys
+  explicit frequency_sketch(size_t capacity) {
+    const size_t words = std::bit_ceil(std::max<size_t>(capacity, 8));
+    _table.assign(words, 0);
+    _mask = words - 1;
+    _sample_size = std::max<size_t>(capacity, 1) * 10;
+  }
+
+  void increment(size_t key_hash) {
+    const uint64_t hash = spread(key_hash);
+    bool added = false;
+    for (size_t depth = 0; depth < 4; ++depth) {
+      auto& word = _table[index_of(hash, depth)];
+      const unsigned offset = offset_of(hash, depth);
+      if (((word >> offset) & 15) != 15) {
+        word += uint64_t(1) << offset;
+        added = true;
+      }
+    }
+    if (added && ++_size >= _sample_size) {
+      reset();
+    }
+  }
+
+  [[nodiscard]] unsigned estimate(size_t key_hash) const {
+    const uint64_t hash = spread(key_hash);
+    unsigned result = 15;
+    for (size_t depth = 0; depth < 4; ++depth) {
+      const auto word = _table[index_of(hash, depth)];
+      result = std::min(
+          result,
+          static_cast<unsigned>((word >> offset_of(hash, depth)) & 15));
+    }
+    return result;
+  }
+
+  [[nodiscard]] size_t memory_size() const {
+    return _table.size() * sizeof(uint64_t);
+  }
+};
+
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
 class cache {
  public:
   struct node {
@@ -14,6 +118,8 @@ class cache {
 
     size_t count = 0;
     size_t sequence = 0;
+    // aging round this count was last halved in
+    uint32_t epoch = 0;
 
     bool operator==(const node& src) const { return key == src.key; }
 
@@ -25,8 +131,9 @@ class cache {
  public:
   using remove_callback = std::function<void(key_tt&& key, value_tt&& value)>;
   using node_container = std::set<node>;
-  using node_map =
-      std::unordered_map<key_tt, typename node_container::iterator>;
+  using node_map = std::unordered_map<key_tt, typename node_container::iterator,
+                                      hash_tt, key_equal_tt>;
+  using clock_type = std::chrono::steady_clock;
 
  private:
   node_container _nodes;
@@ -36,6 +143,114 @@ class cache {
 
   std::size_t _sequence = 0;
 
+  // aging, off while both _age_every and _age_interval are 0
+  size_t _age_every = 0;
+  clock_type::duration _age_interval{};
+  size_t _age_batch = 0;
+  size_t _ops = 0;
+  clock_type::time_point _aged_at = clock_type::now();
+  uint32_t _epoch = 0;
+  // next node the running round halves, end() when no round is running
+  typename node_container::iterator _age_cursor = _nodes.end();
+
+ private:
+  // the node leaves the set, keep the aging cursor valid
+  void unlink(typename node_container::iterator iter) {
+    if (iter == _age_cursor) {
+      ++_age_cursor;
+    }
+  }
+
+  void touch(typename node_map::iterator iter) {
+    unlink(iter->second);
+    auto handle = _nodes.extract(iter->second);
+    auto& one = handle.value();
+    // not reached by the running round yet, halve before counting
+    if (one.epoch != _epoch) {
+      one.count /= 2;
+      one.epoch = _epoch;
+    }
+    one.count += 1;
+    one.sequence = ++_sequence;
+    iter->second = _nodes.insert(std::move(handle)).position;
+  }
+
+  /*
+   * a round walks the set in ascending order and halves a few nodes per
+   * operation, a halved node sorts before the cursor so it is never seen
+   * twice; nodes touched ahead of the cursor are halved in touch (epoch)
+   */
+  void age(size_t ops) {
+    if (_age_every == 0 && _age_interval == clock_type::duration::zero())
+      return;
+
+    if (_age_cursor == _nodes.end()) {
+      _ops += ops;
+      bool due = _age_every > 0 && _ops >= _age_every;
+      if (!due && _age_interval != clock_type::duration::zero()) {
+        const auto now = clock_type::now();
+        due = now - _aged_at >= _age_interval;
+        if (due) {
+          _aged_at = now;
+        }
+      }
+      if (!due || _nodes.empty())
+        return;
+
+      _ops = 0;
+      ++_epoch;
+      _age_cursor = _nodes.begin();
+    }
+
+    for (size_t i = 0; i < _age_batch * ops && _age_cursor != _nodes.end();
+         ++i) {
+      auto iter = _age_cursor++;
+      if (iter->epoch == _epoch)
+        continue;
+
+      auto handle = _nodes.extract(iter);
+      handle.value().count /= 2;
+      handle.value().epoch = _epoch;
+      auto& position = _key2node.find(handle.value().key)->second;
+      position = _nodes.insert(std::move(handle)).position;
+    }
+  }
+
+  // a new node (count 0, newest sequence) sorts after every count 0 node and
+  // before every count >= 1 node, so the node right after the previous insert
+  // is the exact position of the next one: batches emplace_hint in O(1)
+  typename node_container::iterator insert(
+      const key_tt& key, const value_tt& value,
+      typename node_container::iterator hint) {
+    while (_nodes.size() >= max_size) {
+      if (hint == _nodes.begin()) {
+        ++hint;
+      }
+      auto one = (*_nodes.begin());
+      unlink(_nodes.begin());
+      _key2node.erase(_nodes.begin()->key);
+      _nodes.erase(_nodes.begin());
+
+      if (_on_remove) {
+        _on_remove(std::move(one.key), std::move(one.value));
+      }
+    }
+
+    auto iter = _nodes.emplace_hint(hint, key, value, 0, ++_sequence, _epoch);
+    _key2node[key] = iter;
+    return iter;
+  }
+
+  template <class lookup_tt>
+  const value_tt* do_get(const lookup_tt& key) {
+    age(1);
+    if (auto iter = _key2node.find(key); iter != _key2node.end()) {
+      touch(iter);
+      return &(iter->second->value);
+    }
+    return nullptr;
+  }
+
  public:
   explicit cache(remove_callback&& on_remove) : _on_remove(on_remove) {}
 
@@ -48,37 +263,576 @@ class cache {
     if (max_size == 0)
       return false;
 
+    age(1);
     if (auto iter = _key2node.find(key); iter != _key2node.end()) {
-      auto one = *(iter->second);
-      one.count += 1;
-      one.sequence = ++_sequence;
-      _nodes.erase(iter->second);
-      iter->second = _nodes.emplace(one).first;
+      touch(iter);
       return true;
     }
 
-    while (_nodes.size() >= max_size) {
-      auto one = (*_nodes.begin());
-      _key2node.erase(_nodes.begin()->key);
-      _nodes.erase(_nodes.begin());
+    insert(key, value, _nodes.end());
+    return true;
+  }
 
-      if (_on_remove) {
-        _on_remove(std::move(one.key), std::move(one.value));
+  /*
+   * halve every count once per `every_ops` put/get, or once per `interval`
+   * (whichever comes first, 0 disables that trigger), so last week's hot
+   * keys can be evicted by today's
+   * a round is spread over the following operations, `batch` nodes each
+   */
+  void set_aging(size_t every_ops, clock_type::duration interval = {},
+                 size_t batch = 4) {
+    _age_every = every_ops;
+    _age_interval = interval;
+    _age_batch = std::max<size_t>(batch, 1);
+    _ops = 0;
+    _aged_at = clock_type::now();
+  }
+
+  // same as put for each element, new keys are inserted with a hint so the
+  // batch skips the per-element tree descent, return put count
+  size_t multi_put(std::span<const std::pair<key_tt, value_tt>> elements) {
+    if (max_size == 0)
+      return 0;
+
+    // the whole batch's aging share runs first, it would move the hint
+    age(elements.size());
+
+    // first node with count >= 1
+    auto hint = _nodes.lower_bound(node{{}, {}, 1, 0});
+    for (const auto& [key, value] : elements) {
+      if (auto iter = _key2node.find(key); iter != _key2node.end()) {
+        if (iter->second == hint) {
+          ++hint;
+        }
+        touch(iter);
+        continue;
+      }
+      hint = std::next(insert(key, value, hint));
+    }
+    return elements.size();
+  }
+
+  const value_tt* get(const key_tt& key) { return do_get(key); }
+
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  const value_tt* get(const lookup_tt& key) {
+    return do_get(key);
+  }
+
+  // result[i] is the hit for keys[i] or nullptr, return hit count
+  size_t multi_get(std::span<const key_tt> keys,
+                   std::span<const value_tt*> result) {
+    assert(result.size() >= keys.size());
+    size_t hits = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      result[i] = do_get(keys[i]);
+      hits += result[i] != nullptr ? 1 : 0;
+    }
+    return hits;
+  }
+};
+
+/*
+ * O(1) lfu: a list of frequency buckets (ascending count), every bucket is
+ * an lru list of the nodes with that count
+ *
+ * |count 0| -> |count 1| -> |count 4| -> ...
+ *  n5 n3        n2           n4 n1      (front: most recently touched)
+ *
+ * - hit: splice the node to the front of the count + 1 bucket, the node is
+ *   never copied or reallocated; a lone node just bumps its bucket count
+ * - evict: back of the first bucket, the same victim cache picks (lowest
+ *   count, least recently touched)
+ * - same put / get / remove_callback contract as cache
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
+class bucket_cache {
+ public:
+  struct node {
+    key_tt key;
+    value_tt value;
+  };
+  using node_list = std::list<node>;
+
+  struct bucket {
+    size_t count = 0;
+    node_list nodes;
+  };
+  using bucket_list = std::list<bucket>;
+
+  struct position {
+    typename bucket_list::iterator bucket;
+    typename node_list::iterator node;
+  };
+
+  using remove_callback = std::function<void(key_tt&& key, value_tt&& value)>;
+  using node_map = std::unordered_map<key_tt, position, hash_tt, key_equal_tt>;
+
+ private:
+  bucket_list _buckets;
+  node_map _key2node;
+
+  remove_callback _on_remove;
+
+ private:
+  void touch(position& pos) {
+    const auto from = pos.bucket;
+    auto to = std::next(from);
+    if (to == _buckets.end() || to->count != from->count + 1) {
+      if (from->nodes.size() == 1) {
+        from->count += 1;
+        return;
       }
+      to = _buckets.emplace(to, bucket{from->count + 1, {}});
+    }
+
+    to->nodes.splice(to->nodes.begin(), from->nodes, pos.node);
+    pos.bucket = to;
+    if (from->nodes.empty()) {
+      _buckets.erase(from);
+    }
+  }
+
+  void evict() {
+    auto& victims = _buckets.front().nodes;
+    auto one = std::move(victims.back());
+    victims.pop_back();
+    if (victims.empty()) {
+      _buckets.pop_front();
+    }
+    _key2node.erase(one.key);
+
+    if (_on_remove) {
+      _on_remove(std::move(one.key), std::move(one.value));
+    }
+  }
+
+  template <class lookup_tt>
+  const value_tt* do_get(const lookup_tt& key) {
+    if (auto iter = _key2node.find(key); iter != _key2node.end()) {
+      touch(iter->second);
+      return &(iter->second.node->value);
+    }
+    return nullptr;
+  }
+
+ public:
+  explicit bucket_cache(remove_callback&& on_remove)
+      : _on_remove(std::move(on_remove)) {}
+
+  // non-copyable
+  bucket_cache(const bucket_cache&) = delete;
+  bucket_cache(bucket_cache&&) = delete;
+  bucket_cache& operator=(const bucket_cache&) = delete;
+
+  bool put(const key_tt& key, const value_tt& value) {
+    if (max_size == 0)
+      return false;
+
+    if (auto iter = _key2node.find(key); iter != _key2node.end()) {
+      touch(iter->second);
+      return true;
+    }
+
+    while (_key2node.size() >= max_size) {
+      evict();
     }
 
-    _key2node[key] = _nodes.emplace(key, value, 0, ++_sequence).first;
+    if (_buckets.empty() || _buckets.front().count != 0) {
+      _buckets.emplace_front(bucket{0, {}});
+    }
+    auto& zero = _buckets.front();
+    zero.nodes.emplace_front(node{key, value});
+    _key2node.emplace(key, position{_buckets.begin(), zero.nodes.begin()});
     return true;
   }
 
-  const value_tt* get(const key_tt& key) {
+  const value_tt* get(const key_tt& key) { return do_get(key); }
+
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  const value_tt* get(const lookup_tt& key) {
+    return do_get(key);
+  }
+
+  // lookup without counting the access
+  [[nodiscard]] const value_tt* peek(const key_tt& key) const {
     if (auto iter = _key2node.find(key); iter != _key2node.end()) {
-      auto ignore_res = put(key, iter->second->value);
-      iter = _key2node.find(key);
-      return &(iter->second->value);
+      return &(iter->second.node->value);
     }
     return nullptr;
   }
+
+  [[nodiscard]] size_t size() const { return _key2node.size(); }
+};
+
+/*
+ * thread safe bucket_cache, readers never take the write lock
+ * - get: shared lock for the lookup (value is copied out), then the key hash
+ *   is appended to a lossy ring buffer picked by thread id
+ * - a buffer getting half full try_locks the cache and drains every buffer,
+ *   each record counts as one access; put drains before it writes
+ * - lossy: a record is dropped when its buffer is full or the slot race is
+ *   lost, frequencies are approximate under contention (same trade as
+ *   caffeine's read buffers)
+ * - records carry only the hash, a hash -> key index (one key copy per
+ *   entry) maps them back; keys sharing a hash share their records
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>,
+          size_t stripe_count_vv = 16>
+class concurrent_cache {
+  static_assert(stripe_count_vv > 0, "at least one read buffer");
+
+ public:
+  using lfu_type =
+      bucket_cache<key_tt, value_tt, max_size, hash_tt, key_equal_tt>;
+  using remove_callback = typename lfu_type::remove_callback;
+
+  static constexpr size_t buffer_size = 64;
+
+ private:
+  // a slot holds hash + 1, 0 is an empty (or not yet published) slot
+  struct alignas(64) read_buffer {
+    std::array<std::atomic<size_t>, buffer_size> slots{};
+    std::atomic<size_t> head{0};  // next write
+    std::atomic<size_t> tail{0};  // next drain, moved under the write lock
+  };
+
+  mutable std::shared_mutex _mut;
+  std::array<read_buffer, stripe_count_vv> _buffers;
+  std::unordered_map<size_t, key_tt> _hash2key;
+  remove_callback _on_remove;
+  lfu_type _lfu;
+
+ private:
+  static read_buffer& stripe(std::array<read_buffer, stripe_count_vv>& all) {
+    static thread_local const size_t probe =
+        std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return all[probe % stripe_count_vv];
+  }
+
+  // return true when the buffer is worth draining
+  bool record(size_t hash) {
+    auto& buffer = stripe(_buffers);
+    size_t head = buffer.head.load(std::memory_order_relaxed);
+    const size_t tail = buffer.tail.load(std::memory_order_acquire);
+    if (head - tail >= buffer_size)
+      return true;
+    if (!buffer.head.compare_exchange_strong(head, head + 1,
+                                             std::memory_order_relaxed))
+      return false;
+    buffer.slots[head % buffer_size].store(hash + 1,
+                                           std::memory_order_release);
+    return head + 1 - tail >= buffer_size / 2;
+  }
+
+  // caller holds the write lock
+  void drain() {
+    for (auto& buffer : _buffers) {
+      const size_t head = buffer.head.load(std::memory_order_acquire);
+      for (size_t i = buffer.tail.load(std::memory_order_relaxed); i < head;
+           ++i) {
+        const size_t slot = buffer.slots[i % buffer_size].exchange(
+            0, std::memory_order_acquire);
+        if (slot == 0)
+          continue;
+        if (auto iter = _hash2key.find(slot - 1); iter != _hash2key.end()) {
+          _lfu.get(iter->second);
+        }
+      }
+      buffer.tail.store(head, std::memory_order_release);
+    }
+  }
+
+  void on_remove(key_tt&& key, value_tt&& value) {
+    if (auto iter = _hash2key.find(hash_tt{}(key));
+        iter != _hash2key.end() && key_equal_tt{}(iter->second, key)) {
+      _hash2key.erase(iter);
+    }
+    if (_on_remove) {
+      _on_remove(std::move(key), std::move(value));
+    }
+  }
+
+ public:
+  explicit concurrent_cache(remove_callback&& on_remove = nullptr)
+      : _on_remove(std::move(on_remove)),
+        _lfu([this](key_tt&& key, value_tt&& value) {
+          this->on_remove(std::move(key), std::move(value));
+        }) {}
+
+  // non-copyable
+  concurrent_cache(const concurrent_cache&) = delete;
+  concurrent_cache(concurrent_cache&&) = delete;
+  concurrent_cache& operator=(const concurrent_cache&) = delete;
+
+  bool put(const key_tt& key, const value_tt& value) {
+    std::unique_lock<std::shared_mutex> lock(_mut);
+    drain();
+    if (!_lfu.put(key, value))
+      return false;
+    _hash2key.insert_or_assign(hash_tt{}(key), key);
+    return true;
+  }
+
+  // a copy, the entry may be evicted as soon as the shared lock is released
+  std::optional<value_tt> get(const key_tt& key) {
+    std::optional<value_tt> result;
+    {
+      std::shared_lock<std::shared_mutex> lock(_mut);
+      if (const auto* value = _lfu.peek(key)) {
+        result = *value;
+      }
+    }
+    if (result && record(hash_tt{}(key)) && _mut.try_lock()) {
+      drain();
+      _mut.unlock();
+    }
+    return result;
+  }
+
+  [[nodiscard]] size_t size() const {
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    return _lfu.size();
+  }
+};
+
+/*
+ * approximate lfu for huge key spaces
+ * - frequencies live in a frequency_sketch sized by max_size, no per entry
+ *   count / sequence, old popularity fades as the sketch halves
+ * - entries are one dense array, the key index is open addressing of
+ *   uint32_t (load factor <= 0.5): per entry overhead is the cached hash
+ *   (8), 2-4 index slots (8-16) and the sketch share (8-16), fixed by
+ *   max_size
+ * - eviction samples sample_vv random entries and drops the one the sketch
+ *   estimates coldest (redis style), the last entry is moved into the hole
+ * - same put / get / remove_callback contract as cache, not thread safe
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>,
+          size_t sample_vv = 8>
+class sampled_cache {
+ public:
+  using index_type = uint32_t;
+  static constexpr index_type npos = std::numeric_limits<index_type>::max();
+  static constexpr size_t slot_size =
+      std::bit_ceil(max_size * 2 > 2 ? max_size * 2 : size_t(2));
+  static_assert(max_size < npos, "max_size out of index_type range");
+  static_assert(sample_vv > 0, "sample at least one entry");
+
+  struct entry {
+    key_tt key;
+    value_tt value;
+    size_t hash = 0;
+  };
+
+  using remove_callback = std::function<void(key_tt&& key, value_tt&& value)>;
+
+ private:
+  std::vector<entry> _entries;
+  std::vector<index_type> _slots;
+  frequency_sketch _sketch{max_size};
+  uint64_t _random = 0x853c49e6748fea9bull;
+
+  remove_callback _on_remove;
+
+ private:
+  static size_t slot_mask() { return slot_size - 1; }
+
+  // slot position of key, or the empty slot where it would go
+  template <class lookup_tt>
+  size_t find_slot(const lookup_tt& key, size_t hash) const {
+    size_t i = hash & slot_mask();
+    while (_slots[i] != npos) {
+      const auto& one = _entries[_slots[i]];
+      if (one.hash == hash && key_equal_tt{}(one.key, key))
+        return i;
+      i = (i + 1) & slot_mask();
+    }
+    return i;
+  }
+
+  void erase_slot(size_t i) {
+    _slots[i] = npos;
+    for (size_t j = (i + 1) & slot_mask(); _slots[j] != npos;
+         j = (j + 1) & slot_mask()) {
+      const size_t k = _entries[_slots[j]].hash & slot_mask();
+      // move back unless the home slot k lies cyclically in (i, j]
+      if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+        _slots[i] = _slots[j];
+        _slots[j] = npos;
+        i = j;
+      }
+    }
+  }
+
+  // xorshift64
+  size_t random_index() {
+    _random ^= _random << 13;
+    _random ^= _random >> 7;
+    _random ^= _random << 17;
+    return static_cast<size_t>(_random % _entries.size());
+  }
+
+  void evict() {
+    size_t victim = random_index();
+    unsigned coldest = _sketch.estimate(_entries[victim].hash);
+    for (size_t i = 1; i < sample_vv && coldest > 0; ++i) {
+      const size_t one = random_index();
+      const unsigned estimate = _sketch.estimate(_entries[one].hash);
+      if (estimate < coldest) {
+        victim = one;
+        coldest = estimate;
+      }
+    }
+
+    erase_slot(find_slot(_entries[victim].key, _entries[victim].hash));
+    auto one = std::move(_entries[victim]);
+    if (victim + 1 != _entries.size()) {
+      auto& last = _entries.back();
+      _slots[find_slot(last.key, last.hash)] =
+          static_cast<index_type>(victim);
+      _entries[victim] = std::move(last);
+    }
+    _entries.pop_back();
+
+    if (_on_remove) {
+      _on_remove(std::move(one.key), std::move(one.value));
+    }
+  }
+
+  template <class lookup_tt>
+  const value_tt* do_get(const lookup_tt& key) {
+    const size_t hash = hash_tt{}(key);
+    _sketch.increment(hash);
+    const auto index = _slots[find_slot(key, hash)];
+    return index == npos ? nullptr : &(_entries[index].value);
+  }
+
+ public:
+  explicit sampled_cache(remove_callback&& on_remove = nullptr)
+      : _slots(slot_size, npos), _on_remove(std::move(on_remove)) {
+    _entries.reserve(max_size);
+  }
+
+  // non-copyable
+  sampled_cache(const sampled_cache&) = delete;
+  sampled_cache(sampled_cache&&) = delete;
+  sampled_cache& operator=(const sampled_cache&) = delete;
+
+  bool put(const key_tt& key, const value_tt& value) {
+    if (max_size == 0)
+      return false;
+
+    const size_t hash = hash_tt{}(key);
+    _sketch.increment(hash);
+    if (_slots[find_slot(key, hash)] != npos)
+      return true;
+
+    if (_entries.size() >= max_size) {
+      evict();
+    }
+    _slots[find_slot(key, hash)] = static_cast<index_type>(_entries.size());
+    _entries.push_back(entry{key, value, hash});
+    return true;
+  }
+
+  const value_tt* get(const key_tt& key) { return do_get(key); }
+
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  const value_tt* get(const lookup_tt& key) {
+    return do_get(key);
+  }
+
+  [[nodiscard]] size_t size() const { return _entries.size(); }
+
+  // bytes besides the key / value payload, constant for a given max_size
+  [[nodiscard]] size_t overhead_size() const {
+    return _sketch.memory_size() + _slots.size() * sizeof(index_type) +
+           _entries.capacity() * (sizeof(entry) - sizeof(key_tt) -
+                                  sizeof(value_tt));
+  }
 };
 
 };  // namespace easy::lfu
+
+/* benchmark code
+
+// hits: set-based cache copies + erases + re-emplaces the node, bucket_cache
+// splices it into the next bucket
+template <class cache_tt>
+static void lfu_get_hit(benchmark::State &state) {
+  cache_tt c(nullptr);
+  for (uint64_t i = 0; i < 100000; ++i) {
+    c.put(i, i);
+  }
+  uint32_t seed = lcg_seed(12345);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(c.get(lcg_rand(seed) % 100000));
+  }
+}
+
+template <class cache_tt>
+static void lfu_mixed(benchmark::State &state) {
+  cache_tt c(nullptr);
+  uint32_t seed = lcg_seed(12345);
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 200000;
+    if (key & 3) {
+      benchmark::DoNotOptimize(c.get(key));
+    } else {
+      c.put(key, key);
+    }
+  }
+}
+
+BENCHMARK(lfu_get_hit<easy::lfu::cache<uint64_t, uint64_t, 100000>>);
+BENCHMARK(lfu_get_hit<easy::lfu::bucket_cache<uint64_t, uint64_t, 100000>>);
+BENCHMARK(lfu_mixed<easy::lfu::cache<uint64_t, uint64_t, 100000>>);
+BENCHMARK(lfu_mixed<easy::lfu::bucket_cache<uint64_t, uint64_t, 100000>>);
+
+// read heavy from many threads: a mutex around bucket_cache serializes every
+// hit on the frequency bump, concurrent_cache takes the shared lock only
+static void lfu_locked_read_heavy(benchmark::State &state) {
+  static easy::lfu::bucket_cache<uint64_t, uint64_t, 100000> c(nullptr);
+  static std::mutex m;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 100000;
+    std::lock_guard<std::mutex> lock(m);
+    if (key % 16 == 0) {
+      c.put(key, key);
+    } else {
+      benchmark::DoNotOptimize(c.get(key));
+    }
+  }
+}
+
+static void lfu_concurrent_read_heavy(benchmark::State &state) {
+  static easy::lfu::concurrent_cache<uint64_t, uint64_t, 100000> c;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 100000;
+    if (key % 16 == 0) {
+      c.put(key, key);
+    } else {
+      benchmark::DoNotOptimize(c.get(key));
+    }
+  }
+}
+
+BENCHMARK(lfu_locked_read_heavy)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(lfu_concurrent_read_heavy)->ThreadRange(1, 32)->UseRealTime();
+
+*/
@@ -1,29 +1,531 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <functional>
+#include <future>
+#include <limits>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+// windows.h min / max macros would break std::max( / numeric_limits::max()
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "string_util.h"
 
 namespace easy::lru {
 
-template <class key_tt, class value_tt, size_t max_size>
+// https://en.cppreference.com/w/cpp/types/void_t
+// slice object trait, shared by every cache in this file
+template <class slice_object, class key_tt, class value_tt, class = void>
+struct slice_has_on_rem : std::false_type {};
+template <class slice_object, class key_tt, class value_tt>
+struct slice_has_on_rem<
+    slice_object, key_tt, value_tt,
+    std::void_t<decltype(std::declval<slice_object>().on_rem(
+        std::declval<key_tt &>(), std::declval<value_tt &>()))>>
+    : std::true_type {};
+
+// optional hooks next to on_rem (fired on every removal: rem, eviction and
+// expiry), a slice implements any subset of them
+//   on_evict(key_tt &, value_tt &)          capacity / cost eviction only
+//   on_hit(const key_tt &, value_tt &)
+//   on_miss()
+//   on_insert(const key_tt &, value_tt &)
+//   on_get_latency(std::chrono::nanoseconds) one get, lock wait included
+template <class slice_object, class key_tt, class value_tt>
+concept slice_on_evict = requires(slice_object &s, key_tt &k, value_tt &v) {
+  s.on_evict(k, v);
+};
+template <class slice_object, class key_tt, class value_tt>
+concept slice_on_hit =
+    requires(slice_object &s, const key_tt &k, value_tt &v) { s.on_hit(k, v); };
+template <class slice_object>
+concept slice_on_miss = requires(slice_object &s) { s.on_miss(); };
+template <class slice_object, class key_tt, class value_tt>
+concept slice_on_insert = requires(slice_object &s, const key_tt &k,
+                                   value_tt &v) { s.on_insert(k, v); };
+template <class slice_object>
+concept slice_on_get_latency =
+    requires(slice_object &s, std::chrono::nanoseconds ns) {
+      s.on_get_latency(ns);
+    };
+
+/*
+ * built-in stats slice: relaxed atomic counters + log2 histogram of get
+ * latency. copies share the same counters, keep one to read them
+ *
+ *   easy::lru::stats st;
+ *   easy::lru::cache<uint64_t, item, 1024> c(st);
+ *   ...
+ *   st.hit_ratio(); st.latency_percentile(0.99);
+ */
+class stats {
+ public:
+  // bucket i counts gets that took [2^(i-1), 2^i) ns, bucket 0 is 0 ns
+  static constexpr size_t histogram_size = 40;
+
+  struct data {
+    std::atomic_uint64_t hits{0};
+    std::atomic_uint64_t misses{0};
+    std::atomic_uint64_t inserts{0};
+    std::atomic_uint64_t evictions{0};
+    std::atomic_uint64_t removes{0};
+    std::array<std::atomic_uint64_t, histogram_size> latency{};
+  };
+
+ private:
+  std::shared_ptr<data> _data = std::make_shared<data>();
+
+  static void bump(std::atomic_uint64_t &counter) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static uint64_t load(const std::atomic_uint64_t &counter) {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+ public:
+  template <class key_tt, class value_tt>
+  void on_rem(key_tt &, value_tt &) {
+    bump(_data->removes);
+  }
+
+  template <class key_tt, class value_tt>
+  void on_evict(key_tt &, value_tt &) {
+    bump(_data->evictions);
+  }
+
+  template <class key_tt, class value_tt>
+  void on_hit(const key_tt &, value_tt &) {
+    bump(_data->hits);
+  }
+
+  void on_miss() { bump(_data->misses); }
+
+  template <class key_tt, class value_tt>
+  void on_insert(const key_tt &, value_tt &) {
+    bump(_data->inserts);
+  }
+
+  void on_get_latency(std::chrono::nanoseconds ns) {
+    const auto count = static_cast<uint64_t>(std::max<int64_t>(ns.count(), 0));
+    bump(_data->latency[std::min<size_t>(std::bit_width(count),
+                                         histogram_size - 1)]);
+  }
+
+  [[nodiscard]] uint64_t hits() const { return load(_data->hits); }
+  [[nodiscard]] uint64_t misses() const { return load(_data->misses); }
+  [[nodiscard]] uint64_t inserts() const { return load(_data->inserts); }
+  [[nodiscard]] uint64_t evictions() const { return load(_data->evictions); }
+  [[nodiscard]] uint64_t removes() const { return load(_data->removes); }
+
+  [[nodiscard]] double hit_ratio() const {
+    const uint64_t h = hits();
+    const uint64_t total = h + misses();
+    return total == 0 ? 0.0 : static_cast<double>(h) / total;
+  }
+
+  // upper bound of the bucket holding the p-th (0.0 - 1.0) get
+  [[nodiscard]] std::chrono::nanoseconds latency_percentile(double p) const {
+    std::array<uint64_t, histogram_size> counts{};
+    uint64_t total = 0;
+    for (size_t i = 0; i < histogram_size; ++i) {
+      counts[i] = load(_data->latency[i]);
+      total += counts[i];
+    }
+    if (total == 0)
+      return std::chrono::nanoseconds(0);
+
+    const auto target = static_cast<uint64_t>(p * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram_size; ++i) {
+      seen += counts[i];
+      if (seen > target)
+        return std::chrono::nanoseconds(i == 0 ? 0 : (int64_t(1) << i) - 1);
+    }
+    return std::chrono::nanoseconds((int64_t(1) << (histogram_size - 1)) - 1);
+  }
+
+  void reset() {
+    _data->hits = 0;
+    _data->misses = 0;
+    _data->inserts = 0;
+    _data->evictions = 0;
+    _data->removes = 0;
+    for (auto &one : _data->latency) {
+      one = 0;
+    }
+  }
+};
+
+inline void prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+/*
+ * hierarchical timing wheel (level_count levels of 2^level_bits slots)
+ * - level 0 slot = one resolution tick, a slot of level n covers 2^(bits*n)
+ *   ticks and is cascaded down when the wheel reaches it
+ * - records live in one pool, a slot is an intrusive list of pool indexes,
+ *   so schedule returns a stable handle and cancel unlinks it in O(1)
+ */
+template <class key_tt>
+class timing_wheel {
+ public:
+  using clock_type = std::chrono::steady_clock;
+  using time_point = clock_type::time_point;
+  using handle = uint32_t;
+
+  static constexpr handle no_handle = std::numeric_limits<handle>::max();
+
+  static constexpr size_t level_bits = 8;
+  static constexpr size_t level_count = 4;
+  static constexpr size_t slot_count = size_t(1) << level_bits;
+  static constexpr uint64_t max_ticks = uint64_t(1)
+                                        << (level_bits * level_count);
+
+ private:
+  struct record {
+    key_tt key;
+    time_point expire_at;
+    handle prev = no_handle;
+    handle next = no_handle;
+    // level * slot_count + slot
+    uint32_t slot = 0;
+  };
+
+  std::vector<record> _records;
+  std::vector<handle> _free;
+  std::array<handle, level_count * slot_count> _heads;
+
+  const time_point _origin;
+  const clock_type::duration _resolution;
+  uint64_t _current = 0;
+  size_t _size = 0;
+
+ private:
+  // ceil, so a record never fires before its expire_at
+  uint64_t to_tick(time_point tp) const {
+    if (tp <= _origin)
+      return 0;
+    return static_cast<uint64_t>(
+        (tp - _origin + _resolution - clock_type::duration(1)) / _resolution);
+  }
+
+  void link(handle h, uint32_t slot) {
+    auto &one = _records[h];
+    one.slot = slot;
+    one.prev = no_handle;
+    one.next = _heads[slot];
+    if (one.next != no_handle) {
+      _records[one.next].prev = h;
+    }
+    _heads[slot] = h;
+  }
+
+  void unlink(handle h) {
+    const auto &one = _records[h];
+    if (one.prev != no_handle) {
+      _records[one.prev].next = one.next;
+    } else {
+      _heads[one.slot] = one.next;
+    }
+    if (one.next != no_handle) {
+      _records[one.next].prev = one.prev;
+    }
+  }
+
+  // back to the pool, the key is moved out so it does not outlive the record
+  key_tt release(handle h) {
+    _free.emplace_back(h);
+    --_size;
+    return std::move(_records[h].key);
+  }
+
+  // earliest: _current + 1 for a new record, _current when cascading (the
+  // level 0 slot of _current fires right after)
+  void place(handle h, uint64_t earliest) {
+    uint64_t tick = std::max(to_tick(_records[h].expire_at), earliest);
+    if (tick - _current >= max_ticks) {
+      // re-placed with the real expire_at when cascaded
+      tick = _current + max_ticks - 1;
+    }
+
+    const uint64_t delta = tick - _current;
+    for (size_t level = 0; level < level_count; ++level) {
+      if (delta < (uint64_t(1) << (level_bits * (level + 1)))) {
+        link(h, static_cast<uint32_t>(
+                    level * slot_count +
+                    ((tick >> (level_bits * level)) & (slot_count - 1))));
+        return;
+      }
+    }
+  }
+
+  // detach the whole slot list, head of the detached list
+  handle take(size_t level) {
+    const size_t slot =
+        level * slot_count +
+        ((_current >> (level_bits * level)) & (slot_count - 1));
+    return std::exchange(_heads[slot], no_handle);
+  }
+
+  void cascade(size_t level) {
+    for (handle h = take(level); h != no_handle;) {
+      const handle next = _records[h].next;
+      place(h, _current);
+      h = next;
+    }
+  }
+
+ public:
+  timing_wheel(time_point origin, clock_type::duration resolution)
+      : _origin(origin), _resolution(resolution) {
+    _heads.fill(no_handle);
+  }
+
+  // the handle stays valid until it fires or is cancelled
+  handle schedule(const key_tt &key, time_point expire_at) {
+    handle h = no_handle;
+    if (!_free.empty()) {
+      h = _free.back();
+      _free.pop_back();
+      _records[h].key = key;
+      _records[h].expire_at = expire_at;
+    } else {
+      assert(_records.size() < no_handle);
+      h = static_cast<handle>(_records.size());
+      _records.emplace_back(record{key, expire_at});
+    }
+    place(h, _current + 1);
+    ++_size;
+    return h;
+  }
+
+  void cancel(handle h) {
+    unlink(h);
+    release(h);
+  }
+
+  // fire_tt: void(const key_tt &key), the record is already released
+  template <class fire_tt>
+  void advance(time_point now, fire_tt &&fire) {
+    const uint64_t target = now <= _origin ? 0 : (now - _origin) / _resolution;
+    while (_current < target) {
+      if (_size == 0) {
+        _current = target;
+        break;
+      }
+
+      ++_current;
+      for (size_t level = level_count - 1; level > 0; --level) {
+        if ((_current & ((uint64_t(1) << (level_bits * level)) - 1)) == 0) {
+          cascade(level);
+        }
+      }
+
+      for (handle h = take(0); h != no_handle;) {
+        const handle next = _records[h].next;
+        const key_tt key = release(h);
+        fire(key);
+        h = next;
+      }
+    }
+  }
+
+  [[nodiscard]] size_t size() const { return _size; }
+};
+
+/*
+ * dump / load codec, one per key and value type
+ * - size(v): bytes write(v, out) will produce
+ * - write(v, out): out has size(v) bytes
+ * - read(in, avail, v): decode into v, return consumed bytes, 0 on truncation
+ * the default copies the object representation (host byte order)
+ */
+template <class tt>
+struct pod_codec {
+  static_assert(std::is_trivially_copyable_v<tt>,
+                "pod_codec needs a trivially copyable type, pass a codec");
+
+  static size_t size(const tt &) { return sizeof(tt); }
+
+  static void write(const tt &value, char *out) {
+    std::memcpy(out, &value, sizeof(tt));
+  }
+
+  static size_t read(const char *in, size_t avail, tt &value) {
+    if (avail < sizeof(tt))
+      return 0;
+    std::memcpy(&value, in, sizeof(tt));
+    return sizeof(tt);
+  }
+};
+
+// read only mapping of a whole file, empty when open fails
+class mapped_file {
+ private:
+  const char *_data = nullptr;
+  size_t _size = 0;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+  HANDLE _file = INVALID_HANDLE_VALUE;
+  HANDLE _mapping = nullptr;
+#endif
+
+ public:
+  explicit mapped_file(const std::string &path) {
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (_file == INVALID_HANDLE_VALUE)
+      return;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+      return;
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping == nullptr)
+      return;
+    _data = static_cast<const char *>(
+        MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (_data != nullptr)
+      _size = static_cast<size_t>(size.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                          MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        ::madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        _data = static_cast<const char *>(addr);
+        _size = static_cast<size_t>(st.st_size);
+      }
+    }
+    // the mapping outlives the descriptor
+    ::close(fd);
+#endif
+  }
+
+  ~mapped_file() {
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    if (_data != nullptr)
+      UnmapViewOfFile(_data);
+    if (_mapping != nullptr)
+      CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE)
+      CloseHandle(_file);
+#else
+    if (_data != nullptr)
+      ::munmap(const_cast<char *>(_data), _size);
+#endif
+  }
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  [[nodiscard]] const char *data() const { return _data; }
+  [[nodiscard]] size_t size() const { return _size; }
+};
+
+// atomically replace `to` with `from`, an existing `to` is overwritten
+// data reaches the device before the file is renamed into place, otherwise
+// a power loss can leave the renamed file empty or partial
+inline bool sync_file(std::FILE *file) {
+  if (std::fflush(file) != 0)
+    return false;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+  return _commit(_fileno(file)) == 0;
+#else
+  return fsync(fileno(file)) == 0;
+#endif
+}
+
+inline bool replace_file(const std::string &from, const std::string &to) {
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+  return MoveFileExA(from.c_str(), to.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  // rename(2) replaces the target atomically
+  return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
 class cache {
  public:
+  using clock_type = std::chrono::steady_clock;
+  using time_point = clock_type::time_point;
+
   using element_type = std::pair<key_tt, value_tt>;
   using array_type = std::list<element_type>;
+
+  struct map_value {
+    typename array_type::const_iterator it;
+    time_point expire_at = time_point::max();
+    size_t cost = 0;
+    // record in _wheel while expire_at is set
+    typename timing_wheel<key_tt>::handle timer =
+        timing_wheel<key_tt>::no_handle;
+  };
   using map_type =
-      std::unordered_map<key_tt, typename array_type::const_iterator>;
+      std::unordered_map<key_tt, map_value, hash_tt, key_equal_tt>;
+
+  using cost_function =
+      std::function<size_t(const key_tt &key, const value_tt &value)>;
+
+  // granularity of tick(), get() still checks the exact expire_at
+  static constexpr auto ttl_resolution = std::chrono::milliseconds(100);
+
+  // "lruc" + format version, also rejects a file of the other byte order
+  static constexpr uint64_t snapshot_magic = 0x6c72756300000001ull;
+
+  struct snapshot_header {
+    uint64_t magic = 0;
+    uint64_t count = 0;
+  };
 
  public:
-  // https://en.cppreference.com/w/cpp/types/void_t
-  // slice object trait
-  template <class, class = void>
-  struct has_on_rem : std::false_type {};
   template <class slice_object>
-  struct has_on_rem<slice_object,
-                    std::void_t<decltype(std::declval<slice_object>().on_rem(
-                        std::declval<key_tt &>(), std::declval<value_tt &>()))>>
-      : std::true_type {};
+  using has_on_rem = slice_has_on_rem<slice_object, key_tt, value_tt>;
 
   template <class slice_object>
   static constexpr bool has_on_rem_v = has_on_rem<slice_object>::value;
@@ -33,25 +535,186 @@ class cache {
   map_type _data_map;
   mutable std::mutex _mut;
 
+  // created on the first add with ttl
+  std::unique_ptr<timing_wheel<key_tt>> _wheel;
+
+  // 0: no cost budget, only max_size bounds the cache
+  size_t _max_cost = 0;
+  size_t _cost = 0;
+  cost_function _cost_fn;
+
+  // keys being loaded by get_or_load, waiters share the leader's future
+  std::unordered_map<key_tt, std::shared_future<value_tt>, hash_tt,
+                     key_equal_tt>
+      _loading;
+
+  // bound once by the constructor, this is not free: a hook no slice
+  // implements stays an empty std::function that every call site still
+  // tests at runtime, a bound one is an indirect call into the slice tuple
   std::function<void(key_tt &key, value_tt &value)> _on_rem;
+  std::function<void(key_tt &key, value_tt &value)> _on_evict;
+  std::function<void(const key_tt &key, value_tt &value)> _on_hit;
+  std::function<void()> _on_miss;
+  std::function<void(const key_tt &key, value_tt &value)> _on_insert;
+  std::function<void(std::chrono::nanoseconds ns)> _on_get_latency;
 
  private:
   template <class slice_tt>
-  void do_on_rem(slice_tt &s, key_tt &key, value_tt &value) {
+  static void do_on_rem(slice_tt &s, key_tt &key, value_tt &value) {
     if constexpr (has_on_rem_v<slice_tt>) {
       s.on_rem(key, value);
     }
   }
 
+  // fn(s) for every slice s it is callable with
+  template <class slices_tt, class fn_tt>
+  static void each_slice(slices_tt &slices, fn_tt &&fn) {
+    std::apply(
+        [&fn](auto &...s) {
+          (
+              [&fn](auto &one) {
+                if constexpr (std::is_invocable_v<fn_tt &, decltype(one)>) {
+                  fn(one);
+                }
+              }(s),
+              ...);
+        },
+        slices);
+  }
+
+  // every hook shares the same slice objects
+  template <class... slices_tt>
+  void bind_slices(std::shared_ptr<std::tuple<slices_tt...>> slices) {
+    if constexpr ((has_on_rem_v<slices_tt> || ...)) {
+      _on_rem = [slices](key_tt &key, value_tt &value) {
+        std::apply([&](auto &...s) { (do_on_rem(s, key, value), ...); },
+                   *slices);
+      };
+    }
+    if constexpr ((slice_on_evict<slices_tt, key_tt, value_tt> || ...)) {
+      _on_evict = [slices](key_tt &key, value_tt &value) {
+        each_slice(*slices, [&](auto &s) -> decltype(s.on_evict(key, value)) {
+          s.on_evict(key, value);
+        });
+      };
+    }
+    if constexpr ((slice_on_hit<slices_tt, key_tt, value_tt> || ...)) {
+      _on_hit = [slices](const key_tt &key, value_tt &value) {
+        each_slice(*slices, [&](auto &s) -> decltype(s.on_hit(key, value)) {
+          s.on_hit(key, value);
+        });
+      };
+    }
+    if constexpr ((slice_on_miss<slices_tt> || ...)) {
+      _on_miss = [slices]() {
+        each_slice(*slices,
+                   [](auto &s) -> decltype(s.on_miss()) { s.on_miss(); });
+      };
+    }
+    if constexpr ((slice_on_insert<slices_tt, key_tt, value_tt> || ...)) {
+      _on_insert = [slices](const key_tt &key, value_tt &value) {
+        each_slice(*slices, [&](auto &s) -> decltype(s.on_insert(key, value)) {
+          s.on_insert(key, value);
+        });
+      };
+    }
+    if constexpr ((slice_on_get_latency<slices_tt> || ...)) {
+      _on_get_latency = [slices](std::chrono::nanoseconds ns) {
+        each_slice(*slices, [ns](auto &s) -> decltype(s.on_get_latency(ns)) {
+          s.on_get_latency(ns);
+        });
+      };
+    }
+  }
+
+  static bool expired(time_point expire_at) {
+    return expire_at != time_point::max() && expire_at <= clock_type::now();
+  }
+
+  // evicted: removed for capacity / cost, not by rem or expiry
+  void erase(typename map_type::iterator iter, bool evicted = false) {
+    auto element = *(iter->second.it);
+
+    unschedule(iter->second);
+    _cost -= iter->second.cost;
+    _data_array.erase(iter->second.it);
+    _data_map.erase(iter);
+
+    if (evicted && _on_evict) {
+      _on_evict(element.first, element.second);
+    }
+    if (_on_rem) {
+      _on_rem(element.first, element.second);
+    }
+  }
+
+  void unschedule(map_value &one) {
+    if (one.timer != timing_wheel<key_tt>::no_handle) {
+      _wheel->cancel(one.timer);
+      one.timer = timing_wheel<key_tt>::no_handle;
+    }
+  }
+
+  void erase_back(bool evicted) {
+    erase(_data_map.find(_data_array.back().first), evicted);
+  }
+
+  // evict from the tail until `incoming` more cost and one more entry fit
+  void shrink(size_t incoming) {
+    while (!_data_array.empty() &&
+           (_data_array.size() >= max_size ||
+            (_max_cost > 0 && _cost + incoming > _max_cost))) {
+      erase_back(true);
+    }
+  }
+
+  // caller holds _mut
+  bool insert(const key_tt &key, const value_tt &value, time_point expire_at) {
+    if (max_size == 0)
+      return false;
+
+    // reject before touching an existing entry, it keeps its old value
+    const size_t cost = _cost_fn ? _cost_fn(key, value) : 0;
+    if (_max_cost > 0 && cost > _max_cost)
+      return false;
+
+    const auto &iter = _data_map.find(key);
+    if (iter != _data_map.cend()) {
+      unschedule(iter->second);
+      _cost -= iter->second.cost;
+      _data_array.erase(iter->second.it);
+      _data_map.erase(iter);
+    }
+
+    shrink(cost);
+
+    _cost += cost;
+    _data_array.emplace_front(key, value);
+    auto &one = _data_map
+                    .emplace(key, map_value{_data_array.begin(), expire_at,
+                                            cost})
+                    .first->second;
+
+    if (_on_insert) {
+      _on_insert(key, _data_array.front().second);
+    }
+
+    if (expire_at != time_point::max()) {
+      if (!_wheel) {
+        _wheel = std::make_unique<timing_wheel<key_tt>>(clock_type::now(),
+                                                        ttl_resolution);
+      }
+      one.timer = _wheel->schedule(key, expire_at);
+    }
+    return true;
+  }
+
  public:
   template <class... slice_args>
   explicit cache(slice_args &&...sargs) {
-    // https://stackoverflow.com/questions/47496358/c-lambdas-how-to-capture-variadic-parameter-pack-from-the-upper-scope
     if constexpr (sizeof...(slice_args) > 0) {
-      _on_rem = [this, ... sargs = std::forward<slice_args>(sargs)](
-                    key_tt &key, value_tt &value) mutable {
-        (do_on_rem(sargs, key, value), ...);
-      };
+      bind_slices(std::make_shared<std::tuple<std::decay_t<slice_args>...>>(
+          std::forward<slice_args>(sargs)...));
     }
   }
 
@@ -68,72 +731,1275 @@ class cache {
 
   bool add(const key_tt &key, const value_tt &value) {
     std::lock_guard<std::mutex> lock(_mut);
-    if (max_size == 0)
-      return false;
+    return insert(key, value, time_point::max());
+  }
+
+  bool add(const key_tt &key, const value_tt &value,
+           clock_type::duration ttl) {
+    std::lock_guard<std::mutex> lock(_mut);
+    return insert(key, value, clock_type::now() + ttl);
+  }
 
+ private:
+  template <class lookup_tt>
+  void do_rem(const lookup_tt &key) {
+    std::lock_guard<std::mutex> lock(_mut);
     const auto &iter = _data_map.find(key);
-    if (iter != _data_map.cend()) {
-      _data_array.erase(iter->second);
-      _data_map.erase(iter);
+    if (iter == _data_map.end())
+      return;
+
+    erase(iter);
+  }
+
+  // caller holds _mut
+  template <class lookup_tt>
+  value_tt *do_get(const lookup_tt &key) {
+    const auto &iter = _data_map.find(key);
+    if (iter == _data_map.end()) {
+      if (_on_miss) {
+        _on_miss();
+      }
+      return nullptr;
     }
-    if (_data_array.size() >= max_size) {
-      auto last = _data_array.back();
-      _data_array.pop_back();
-      _data_map.erase(last.first);
 
-      if (_on_rem) {
-        _on_rem(last.first, last.second);
+    if (expired(iter->second.expire_at)) {
+      erase(iter);
+      if (_on_miss) {
+        _on_miss();
       }
+      return nullptr;
     }
 
-    _data_array.emplace_front(key, value);
-    _data_map.emplace(key, _data_array.begin());
-    return true;
+    // relink the node to the front, iterators in _data_map stay valid
+    _data_array.splice(_data_array.begin(), _data_array, iter->second.it);
+    auto &element = _data_array.front();
+    if (_on_hit) {
+      _on_hit(element.first, element.second);
+    }
+    return &(element.second);
   }
 
-  void rem(const key_tt &key) {
+  struct flight {
+    std::optional<value_tt> hit;
+    std::shared_future<value_tt> future;
+    // set when this caller has to run the loader
+    std::shared_ptr<std::promise<value_tt>> leader;
+  };
+
+  // hit, or join the running load of key, or become its leader
+  flight join(const key_tt &key) {
     std::lock_guard<std::mutex> lock(_mut);
-    const auto &iter = _data_map.find(key);
-    if (iter == _data_map.end())
-      return;
+    flight result;
+    if (value_tt *value = do_get(key)) {
+      result.hit = *value;
+      return result;
+    }
+    if (const auto iter = _loading.find(key); iter != _loading.end()) {
+      result.future = iter->second;
+      return result;
+    }
+    result.leader = std::make_shared<std::promise<value_tt>>();
+    result.future = result.leader->get_future().share();
+    _loading.emplace(key, result.future);
+    return result;
+  }
 
-    auto element = *(iter->second);
+  // leader only: publish the value (or the exception) to the cache and every
+  // waiter, the flight is always unregistered
+  template <class loader_tt>
+  void finish_load(const key_tt &key, loader_tt &loader,
+                   std::promise<value_tt> &promise) {
+    try {
+      value_tt value = loader();
+      {
+        std::lock_guard<std::mutex> lock(_mut);
+        insert(key, value, time_point::max());
+        _loading.erase(key);
+      }
+      promise.set_value(std::move(value));
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(_mut);
+        _loading.erase(key);
+      }
+      promise.set_exception(std::current_exception());
+    }
+  }
 
-    _data_array.erase(iter->second);
-    _data_map.erase(iter);
+  template <class lookup_tt, class fn_tt>
+  bool locked_get_with(const lookup_tt &key, fn_tt &fn) {
+    if (!_on_get_latency) {
+      std::lock_guard<std::mutex> lock(_mut);
+      value_tt *value = do_get(key);
+      if (value != nullptr) {
+        fn(*value);
+      }
+      return value != nullptr;
+    }
 
-    if (_on_rem) {
-      _on_rem(element.first, element.second);
+    const auto start = clock_type::now();
+    bool hit = false;
+    {
+      std::lock_guard<std::mutex> lock(_mut);
+      if (value_tt *value = do_get(key)) {
+        fn(*value);
+        hit = true;
+      }
     }
+    _on_get_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now() - start));
+    return hit;
   }
 
-  value_tt *get(const key_tt &key) {
-    std::lock_guard<std::mutex> lock(_mut);
+  template <class lookup_tt>
+  value_tt *locked_get(const lookup_tt &key) {
+    value_tt *result = nullptr;
+    auto keep = [&result](value_tt &value) { result = &value; };
+    locked_get_with(key, keep);
+    return result;
+  }
 
-    const auto &iter = _data_map.find(key);
-    if (iter == _data_map.end())
-      return nullptr;
+ public:
+  void rem(const key_tt &key) { do_rem(key); }
 
-    auto element = *(iter->second);
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  void rem(const lookup_tt &key) {
+    do_rem(key);
+  }
 
-    _data_array.erase(iter->second);
-    _data_map.erase(iter);
+  // the pointer is only safe while no other thread touches the cache, share
+  // the cache between threads through get_with
+  value_tt *get(const key_tt &key) { return locked_get(key); }
 
-    _data_array.emplace_front(element);
-    _data_map.emplace(element.first, _data_array.begin());
-    return element.second;
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  value_tt *get(const lookup_tt &key) {
+    return locked_get(key);
   }
 
-  void pop() {
+  // fn(value_tt &value) runs under the lock on a hit, return whether it hit
+  template <class fn_tt>
+  bool get_with(const key_tt &key, fn_tt &&fn) {
+    return locked_get_with(key, fn);
+  }
+
+  template <class lookup_tt, class fn_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  bool get_with(const lookup_tt &key, fn_tt &&fn) {
+    return locked_get_with(key, fn);
+  }
+
+  // single flight: on a miss exactly one caller runs loader (value_tt()),
+  // concurrent callers of the same key wait for its result. a loader
+  // exception is rethrown to every one of them and nothing is cached
+  template <class loader_tt>
+  value_tt get_or_load(const key_tt &key, loader_tt &&loader) {
+    auto one = join(key);
+    if (one.hit)
+      return std::move(*one.hit);
+    if (one.leader) {
+      finish_load(key, loader, *one.leader);
+    }
+    return one.future.get();
+  }
+
+  // same, the loader runs on worker `index` of pool (inlay::base::work_threads
+  // or anything with submit(index, fn)); never call it from that worker
+  template <class loader_tt, class pool_tt>
+  value_tt get_or_load(const key_tt &key, loader_tt &&loader, pool_tt &pool,
+                       size_t index) {
+    auto one = join(key);
+    if (one.hit)
+      return std::move(*one.hit);
+    if (one.leader) {
+      try {
+        pool.submit(index, [this, key, leader = one.leader,
+                            loader = std::forward<loader_tt>(loader)]() mutable {
+          finish_load(key, loader, *leader);
+        });
+      } catch (...) {
+        {
+          std::lock_guard<std::mutex> lock(_mut);
+          _loading.erase(key);
+        }
+        one.leader->set_exception(std::current_exception());
+      }
+    }
+    return one.future.get();
+  }
+
+  // one lock for the whole batch, result[i] is the hit for keys[i] or nullptr
+  // return hit count (on_hit/on_miss fire per key, on_get_latency does not)
+  size_t multi_get(std::span<const key_tt> keys,
+                   std::span<value_tt *> result) {
+    assert(result.size() >= keys.size());
+    return multi_get_with(
+        keys.size(), [&keys](size_t i) -> const key_tt & { return keys[i]; },
+        [&result](size_t i, value_tt *value) { result[i] = value; });
+  }
+
+  // key_at_tt: const lookup_tt &(size_t i)
+  // emit_tt: void(size_t i, value_tt *value)
+  template <class key_at_tt, class emit_tt>
+  size_t multi_get_with(size_t count, key_at_tt &&key_at, emit_tt &&emit) {
     std::lock_guard<std::mutex> lock(_mut);
-    auto last = _data_array.back();
-    _data_array.pop_back();
-    _data_map.erase(last.first);
+    size_t hits = 0;
+    for (size_t i = 0; i < count; ++i) {
+      value_tt *value = do_get(key_at(i));
+      hits += value != nullptr ? 1 : 0;
+      emit(i, value);
+    }
+    return hits;
+  }
 
-    if (_on_rem) {
-      _on_rem(last.first, last.second);
+  // one lock for the whole batch, return added count
+  size_t multi_put(std::span<const element_type> elements) {
+    return multi_put_with(
+        elements.size(),
+        [&elements](size_t i) -> const element_type & { return elements[i]; });
+  }
+
+  // element_at_tt: const element_type &(size_t i)
+  template <class element_at_tt>
+  size_t multi_put_with(size_t count, element_at_tt &&element_at) {
+    std::lock_guard<std::mutex> lock(_mut);
+    size_t added = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const auto &one = element_at(i);
+      added += insert(one.first, one.second, time_point::max()) ? 1 : 0;
     }
+    return added;
   }
-};
 
-};  // namespace easy::lru
+  void pop() {
+    std::lock_guard<std::mutex> lock(_mut);
+    if (_data_array.empty())
+      return;
+    erase_back(false);
+  }
+
+  // byte (or any unit) budget, evaluated by cost_fn once per add
+  // entries added before keep the cost they had (0 without a cost_fn)
+  // max_cost 0 turns the budget off
+  void set_max_cost(size_t max_cost, cost_function cost_fn) {
+    std::lock_guard<std::mutex> lock(_mut);
+    _max_cost = max_cost;
+    _cost_fn = std::move(cost_fn);
+    while (_max_cost > 0 && _cost > _max_cost) {
+      erase_back(true);
+    }
+  }
+
+  [[nodiscard]] size_t cost() const {
+    std::lock_guard<std::mutex> lock(_mut);
+    return _cost;
+  }
+
+  // advance the timing wheel, reclaim everything expired up to now
+  // return reclaimed count
+  size_t tick(time_point now = clock_type::now()) {
+    std::lock_guard<std::mutex> lock(_mut);
+    if (!_wheel)
+      return 0;
+
+    size_t count = 0;
+    _wheel->advance(now, [this, &count](const key_tt &key) {
+      // rem / overwrite / evict cancel the record, so the entry is there
+      const auto iter = _data_map.find(key);
+      if (iter == _data_map.end())
+        return;
+      iter->second.timer = timing_wheel<key_tt>::no_handle;
+      erase(iter);
+      ++count;
+    });
+    return count;
+  }
+
+  /*
+   * snapshot file: header {magic, count} then count entries of
+   * key bytes + value bytes, oldest first, so load() replays them with add
+   * and ends up with the same recency order
+   * - ttl is not kept (steady_clock does not survive a restart), entries
+   *   already expired are skipped
+   * - written to path.tmp, synced, then renamed over path in one step, a
+   *   crash or power loss leaves either the old or the new snapshot, never
+   *   half of one or none
+   */
+  template <class key_codec_tt = pod_codec<key_tt>,
+            class value_codec_tt = pod_codec<value_tt>>
+  bool dump(const std::string &path) const {
+    std::vector<char> buffer(sizeof(snapshot_header));
+    uint64_t count = 0;
+    {
+      std::lock_guard<std::mutex> lock(_mut);
+      for (auto it = _data_array.crbegin(); it != _data_array.crend(); ++it) {
+        if (expired(_data_map.find(it->first)->second.expire_at))
+          continue;
+        const size_t key_size = key_codec_tt::size(it->first);
+        const size_t value_size = value_codec_tt::size(it->second);
+        const size_t offset = buffer.size();
+        buffer.resize(offset + key_size + value_size);
+        key_codec_tt::write(it->first, buffer.data() + offset);
+        value_codec_tt::write(it->second, buffer.data() + offset + key_size);
+        ++count;
+      }
+    }
+    const snapshot_header header{snapshot_magic, count};
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    const std::string tmp = path + ".tmp";
+    std::FILE *file = std::fopen(tmp.c_str(), "wb");
+    if (file == nullptr)
+      return false;
+    const bool written =
+        std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() &&
+        sync_file(file);
+    if (std::fclose(file) != 0 || !written) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+    return replace_file(tmp, path);
+  }
+
+  // add every entry of a dump() file, return loaded count
+  // a missing, foreign or truncated file loads nothing
+  template <class key_codec_tt = pod_codec<key_tt>,
+            class value_codec_tt = pod_codec<value_tt>>
+  size_t load(const std::string &path) {
+    const mapped_file file(path);
+    if (file.size() < sizeof(snapshot_header))
+      return 0;
+
+    snapshot_header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != snapshot_magic)
+      return 0;
+
+    // decode outside the lock, the file is only read once front to back
+    std::vector<element_type> elements;
+    elements.reserve(std::min<uint64_t>(header.count, max_size));
+    const char *cursor = file.data() + sizeof(header);
+    const char *const end = file.data() + file.size();
+    for (uint64_t i = 0; i < header.count; ++i) {
+      element_type one{};
+      const size_t key_size =
+          key_codec_tt::read(cursor, static_cast<size_t>(end - cursor),
+                             one.first);
+      if (key_size == 0)
+        return 0;
+      cursor += key_size;
+      const size_t value_size =
+          value_codec_tt::read(cursor, static_cast<size_t>(end - cursor),
+                               one.second);
+      if (value_size == 0)
+        return 0;
+      cursor += value_size;
+      // only the newest max_size entries survive the replay
+      if (header.count - i <= max_size) {
+        elements.emplace_back(std::move(one));
+      }
+    }
+
+    return multi_put(elements);
+  }
+};
+
+/*
+ * allocation free storage
+ * - nodes live in one preallocated array, lru links are prev/next indices
+ * - key index is open addressing (linear probing, backward shift delete),
+ *   sized to a power of two >= 2 * max_size so the load factor stays <= 0.5
+ * - free nodes are chained through `next`, so add/get/rem/pop never touch
+ *   the heap once constructed (key/value are assigned, not re-created)
+ * - key_tt and value_tt must be default constructible
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
+class flat_cache {
+ public:
+  using index_type = uint32_t;
+  static constexpr index_type npos = std::numeric_limits<index_type>::max();
+  static constexpr size_t slot_size =
+      std::bit_ceil(max_size * 2 > 2 ? max_size * 2 : size_t(2));
+  static_assert(max_size < npos, "max_size out of index_type range");
+
+  struct node {
+    key_tt key{};
+    value_tt value{};
+    size_t hash = 0;
+    index_type prev = npos;
+    index_type next = npos;
+  };
+
+  template <class slice_object>
+  static constexpr bool has_on_rem_v =
+      slice_has_on_rem<slice_object, key_tt, value_tt>::value;
+
+ private:
+  std::vector<node> _nodes;
+  std::vector<index_type> _slots;
+  index_type _head = npos;
+  index_type _tail = npos;
+  index_type _free = npos;
+  size_t _size = 0;
+  mutable std::mutex _mut;
+
+  std::function<void(key_tt &key, value_tt &value)> _on_rem;
+
+ private:
+  template <class slice_tt>
+  void do_on_rem(slice_tt &s, key_tt &key, value_tt &value) {
+    if constexpr (has_on_rem_v<slice_tt>) {
+      s.on_rem(key, value);
+    }
+  }
+
+  static size_t slot_mask() { return slot_size - 1; }
+
+  // slot position of key, or the empty slot where it would go
+  template <class lookup_tt>
+  size_t find_slot(const lookup_tt &key, size_t hash) const {
+    size_t i = hash & slot_mask();
+    while (_slots[i] != npos) {
+      const auto &one = _nodes[_slots[i]];
+      if (one.hash == hash && key_equal_tt{}(one.key, key))
+        return i;
+      i = (i + 1) & slot_mask();
+    }
+    return i;
+  }
+
+  void erase_slot(size_t i) {
+    _slots[i] = npos;
+    for (size_t j = (i + 1) & slot_mask(); _slots[j] != npos;
+         j = (j + 1) & slot_mask()) {
+      const size_t k = _nodes[_slots[j]].hash & slot_mask();
+      // move back unless the home slot k lies cyclically in (i, j]
+      if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+        _slots[i] = _slots[j];
+        _slots[j] = npos;
+        i = j;
+      }
+    }
+  }
+
+  void unlink(index_type index) {
+    auto &one = _nodes[index];
+    if (one.prev != npos)
+      _nodes[one.prev].next = one.next;
+    else
+      _head = one.next;
+    if (one.next != npos)
+      _nodes[one.next].prev = one.prev;
+    else
+      _tail = one.prev;
+  }
+
+  void link_front(index_type index) {
+    auto &one = _nodes[index];
+    one.prev = npos;
+    one.next = _head;
+    if (_head != npos)
+      _nodes[_head].prev = index;
+    _head = index;
+    if (_tail == npos)
+      _tail = index;
+  }
+
+  // unlink + unindex + free, fires on_rem
+  void drop(index_type index) {
+    auto &one = _nodes[index];
+    erase_slot(find_slot(one.key, one.hash));
+    unlink(index);
+    --_size;
+
+    if (_on_rem) {
+      _on_rem(one.key, one.value);
+    }
+
+    one.next = _free;
+    _free = index;
+  }
+
+ public:
+  template <class... slice_args>
+  explicit flat_cache(slice_args &&...sargs)
+      : _nodes(max_size), _slots(slot_size, npos) {
+    for (size_t i = 0; i < max_size; ++i) {
+      _nodes[i].next = i + 1 < max_size ? static_cast<index_type>(i + 1) : npos;
+    }
+    _free = max_size > 0 ? 0 : npos;
+
+    if constexpr (sizeof...(slice_args) > 0) {
+      _on_rem = [this, ... sargs = std::forward<slice_args>(sargs)](
+                    key_tt &key, value_tt &value) mutable {
+        (do_on_rem(sargs, key, value), ...);
+      };
+    }
+  }
+
+  ~flat_cache() = default;
+
+  // non-copyable
+  flat_cache(const flat_cache &) = delete;
+  flat_cache(flat_cache &&) = delete;
+  flat_cache &operator=(const flat_cache &) = delete;
+
+  bool add(const key_tt &key, const value_tt &value) {
+    std::lock_guard<std::mutex> lock(_mut);
+    return insert(key, value, hash_tt{}(key));
+  }
+
+ private:
+  // caller holds _mut
+  bool insert(const key_tt &key, const value_tt &value, size_t hash) {
+    if (max_size == 0)
+      return false;
+
+    if (const auto slot = find_slot(key, hash); _slots[slot] != npos) {
+      const auto index = _slots[slot];
+      _nodes[index].value = value;
+      unlink(index);
+      link_front(index);
+      return true;
+    }
+
+    if (_free == npos) {
+      drop(_tail);
+    }
+
+    const auto index = _free;
+    auto &one = _nodes[index];
+    _free = one.next;
+
+    one.key = key;
+    one.value = value;
+    one.hash = hash;
+    link_front(index);
+    // slot may have moved after drop's backward shift
+    _slots[find_slot(key, hash)] = index;
+    ++_size;
+    return true;
+  }
+
+  // caller holds _mut
+  template <class lookup_tt>
+  value_tt *do_get(const lookup_tt &key, size_t hash) {
+    const auto slot = find_slot(key, hash);
+    if (_slots[slot] == npos)
+      return nullptr;
+
+    const auto index = _slots[slot];
+    if (index != _head) {
+      unlink(index);
+      link_front(index);
+    }
+    return &(_nodes[index].value);
+  }
+
+  // hash a group of keys first and prefetch their home slots, so the
+  // probes of the group overlap instead of missing one after another
+  static constexpr size_t prefetch_group = 16;
+
+  template <class key_at_tt>
+  void hash_group(size_t offset, size_t count, key_at_tt &key_at,
+                  std::array<size_t, prefetch_group> &hashes) const {
+    for (size_t i = 0; i < count; ++i) {
+      hashes[i] = hash_tt{}(key_at(offset + i));
+      prefetch(&_slots[hashes[i] & slot_mask()]);
+    }
+  }
+
+  template <class lookup_tt>
+  void do_rem(const lookup_tt &key) {
+    std::lock_guard<std::mutex> lock(_mut);
+    const auto slot = find_slot(key, hash_tt{}(key));
+    if (_slots[slot] == npos)
+      return;
+    drop(_slots[slot]);
+  }
+
+ public:
+  void rem(const key_tt &key) { do_rem(key); }
+
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  void rem(const lookup_tt &key) {
+    do_rem(key);
+  }
+
+  // nodes are reused in place, after another thread's add / rem the pointer
+  // silently refers to a different key's value; only use it while no other
+  // thread touches the cache, share the cache between threads through get_with
+  value_tt *get(const key_tt &key) {
+    std::lock_guard<std::mutex> lock(_mut);
+    return do_get(key, hash_tt{}(key));
+  }
+
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  value_tt *get(const lookup_tt &key) {
+    std::lock_guard<std::mutex> lock(_mut);
+    return do_get(key, hash_tt{}(key));
+  }
+
+  // fn(value_tt &value) runs under the lock on a hit, return whether it hit
+  template <class fn_tt>
+  bool get_with(const key_tt &key, fn_tt &&fn) {
+    std::lock_guard<std::mutex> lock(_mut);
+    value_tt *value = do_get(key, hash_tt{}(key));
+    if (value != nullptr) {
+      fn(*value);
+    }
+    return value != nullptr;
+  }
+
+  template <class lookup_tt, class fn_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  bool get_with(const lookup_tt &key, fn_tt &&fn) {
+    std::lock_guard<std::mutex> lock(_mut);
+    value_tt *value = do_get(key, hash_tt{}(key));
+    if (value != nullptr) {
+      fn(*value);
+    }
+    return value != nullptr;
+  }
+
+  // one lock for the whole batch, result[i] is the hit for keys[i] or nullptr
+  // return hit count; same caveat as get, copy the values out in the emit of
+  // multi_get_with when other threads share the cache
+  size_t multi_get(std::span<const key_tt> keys,
+                   std::span<value_tt *> result) {
+    assert(result.size() >= keys.size());
+    return multi_get_with(
+        keys.size(), [&keys](size_t i) -> const key_tt & { return keys[i]; },
+        [&result](size_t i, value_tt *value) { result[i] = value; });
+  }
+
+  // key_at_tt: const lookup_tt &(size_t i)
+  // emit_tt: void(size_t i, value_tt *value), runs under the lock, copy the
+  // value out there if it is used after the call
+  template <class key_at_tt, class emit_tt>
+  size_t multi_get_with(size_t count, key_at_tt &&key_at, emit_tt &&emit) {
+    std::lock_guard<std::mutex> lock(_mut);
+    std::array<size_t, prefetch_group> hashes;
+    size_t hits = 0;
+    for (size_t offset = 0; offset < count; offset += prefetch_group) {
+      const size_t group = std::min(prefetch_group, count - offset);
+      hash_group(offset, group, key_at, hashes);
+      for (size_t i = 0; i < group; ++i) {
+        value_tt *value = do_get(key_at(offset + i), hashes[i]);
+        hits += value != nullptr ? 1 : 0;
+        emit(offset + i, value);
+      }
+    }
+    return hits;
+  }
+
+  // one lock for the whole batch, return added count
+  size_t multi_put(std::span<const std::pair<key_tt, value_tt>> elements) {
+    std::lock_guard<std::mutex> lock(_mut);
+    auto key_at = [&elements](size_t i) -> const key_tt & {
+      return elements[i].first;
+    };
+    std::array<size_t, prefetch_group> hashes;
+    size_t added = 0;
+    for (size_t offset = 0; offset < elements.size();
+         offset += prefetch_group) {
+      const size_t group = std::min(prefetch_group, elements.size() - offset);
+      hash_group(offset, group, key_at, hashes);
+      for (size_t i = 0; i < group; ++i) {
+        const auto &one = elements[offset + i];
+        added += insert(one.first, one.second, hashes[i]) ? 1 : 0;
+      }
+    }
+    return added;
+  }
+
+  void pop() {
+    std::lock_guard<std::mutex> lock(_mut);
+    if (_tail == npos)
+      return;
+    drop(_tail);
+  }
+
+  [[nodiscard]] size_t size() const {
+    std::lock_guard<std::mutex> lock(_mut);
+    return _size;
+  }
+};
+
+/*
+ * CLOCK (second chance) approximation of lru
+ * - get only takes the shared lock and sets the slot's reference bit, so
+ *   readers never serialize on each other
+ * - add/rem/pop take the exclusive lock, eviction sweeps the hand: a set bit
+ *   is cleared and skipped once, the first clear bit is the victim
+ * - slots are preallocated, key_tt and value_tt must be default constructible
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
+class clock_cache {
+ public:
+  struct slot {
+    key_tt key{};
+    value_tt value{};
+    std::atomic_bool referenced{false};
+    bool used = false;
+  };
+  using map_type = std::unordered_map<key_tt, size_t, hash_tt, key_equal_tt>;
+
+  template <class slice_object>
+  static constexpr bool has_on_rem_v =
+      slice_has_on_rem<slice_object, key_tt, value_tt>::value;
+
+ private:
+  std::unique_ptr<slot[]> _slots;
+  std::vector<size_t> _free;
+  map_type _data_map;
+  size_t _hand = 0;
+  mutable std::shared_mutex _mut;
+
+  std::function<void(key_tt &key, value_tt &value)> _on_rem;
+
+ private:
+  template <class slice_tt>
+  void do_on_rem(slice_tt &s, key_tt &key, value_tt &value) {
+    if constexpr (has_on_rem_v<slice_tt>) {
+      s.on_rem(key, value);
+    }
+  }
+
+  // at least one slot must be in use
+  size_t sweep() {
+    for (;;) {
+      auto &one = _slots[_hand];
+      const size_t index = _hand;
+      _hand = (_hand + 1) % max_size;
+      if (!one.used)
+        continue;
+      if (!one.referenced.exchange(false, std::memory_order_relaxed))
+        return index;
+    }
+  }
+
+  void drop(size_t index) {
+    auto &one = _slots[index];
+    _data_map.erase(one.key);
+    one.referenced.store(false, std::memory_order_relaxed);
+    one.used = false;
+
+    if (_on_rem) {
+      _on_rem(one.key, one.value);
+    }
+  }
+
+ public:
+  template <class... slice_args>
+  explicit clock_cache(slice_args &&...sargs)
+      : _slots(std::make_unique<slot[]>(max_size)) {
+    _free.reserve(max_size);
+    for (size_t i = max_size; i > 0; --i) {
+      _free.emplace_back(i - 1);
+    }
+    _data_map.reserve(max_size);
+
+    if constexpr (sizeof...(slice_args) > 0) {
+      _on_rem = [this, ... sargs = std::forward<slice_args>(sargs)](
+                    key_tt &key, value_tt &value) mutable {
+        (do_on_rem(sargs, key, value), ...);
+      };
+    }
+  }
+
+  ~clock_cache() = default;
+
+  // non-copyable
+  clock_cache(const clock_cache &) = delete;
+  clock_cache(clock_cache &&) = delete;
+  clock_cache &operator=(const clock_cache &) = delete;
+
+  bool add(const key_tt &key, const value_tt &value) {
+    std::unique_lock<std::shared_mutex> lock(_mut);
+    return insert(key, value);
+  }
+
+ private:
+  // caller holds the exclusive lock
+  bool insert(const key_tt &key, const value_tt &value) {
+    if (max_size == 0)
+      return false;
+
+    if (const auto iter = _data_map.find(key); iter != _data_map.end()) {
+      auto &one = _slots[iter->second];
+      one.value = value;
+      one.referenced.store(true, std::memory_order_relaxed);
+      return true;
+    }
+
+    size_t index = 0;
+    if (!_free.empty()) {
+      index = _free.back();
+      _free.pop_back();
+    } else {
+      index = sweep();
+      drop(index);
+    }
+
+    auto &one = _slots[index];
+    one.key = key;
+    one.value = value;
+    one.used = true;
+    _data_map.emplace(key, index);
+    return true;
+  }
+
+  template <class lookup_tt>
+  void do_rem(const lookup_tt &key) {
+    std::unique_lock<std::shared_mutex> lock(_mut);
+    const auto iter = _data_map.find(key);
+    if (iter == _data_map.end())
+      return;
+
+    const size_t index = iter->second;
+    drop(index);
+    _free.emplace_back(index);
+  }
+
+  // caller holds the shared (or exclusive) lock
+  template <class lookup_tt>
+  value_tt *do_get(const lookup_tt &key) {
+    const auto iter = _data_map.find(key);
+    if (iter == _data_map.end())
+      return nullptr;
+
+    auto &one = _slots[iter->second];
+    // load first, a hot key should not keep dirtying its cache line
+    if (!one.referenced.load(std::memory_order_relaxed)) {
+      one.referenced.store(true, std::memory_order_relaxed);
+    }
+    return &(one.value);
+  }
+
+  static std::optional<value_tt> copy_of(const value_tt *value) {
+    if (value == nullptr)
+      return std::nullopt;
+    return *value;
+  }
+
+ public:
+  void rem(const key_tt &key) { do_rem(key); }
+
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  void rem(const lookup_tt &key) {
+    do_rem(key);
+  }
+
+  // the value is copied under the shared lock, a writer may reuse the slot
+  // as soon as it is released
+  std::optional<value_tt> get(const key_tt &key) {
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    return copy_of(do_get(key));
+  }
+
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  std::optional<value_tt> get(const lookup_tt &key) {
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    return copy_of(do_get(key));
+  }
+
+  // fn(const value_tt &value) runs under the shared lock on a hit, other
+  // readers may see the same value at the same time; return whether it hit
+  template <class fn_tt>
+  bool get_with(const key_tt &key, fn_tt &&fn) {
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    const value_tt *value = do_get(key);
+    if (value != nullptr) {
+      fn(*value);
+    }
+    return value != nullptr;
+  }
+
+  template <class lookup_tt, class fn_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  bool get_with(const lookup_tt &key, fn_tt &&fn) {
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    const value_tt *value = do_get(key);
+    if (value != nullptr) {
+      fn(*value);
+    }
+    return value != nullptr;
+  }
+
+  // one shared lock for the whole batch
+  // result[i] is a copy of the hit for keys[i] or empty, return hit count
+  size_t multi_get(std::span<const key_tt> keys,
+                   std::span<std::optional<value_tt>> result) {
+    assert(result.size() >= keys.size());
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    size_t hits = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      result[i] = copy_of(do_get(keys[i]));
+      hits += result[i].has_value() ? 1 : 0;
+    }
+    return hits;
+  }
+
+  // one exclusive lock for the whole batch, return added count
+  size_t multi_put(std::span<const std::pair<key_tt, value_tt>> elements) {
+    std::unique_lock<std::shared_mutex> lock(_mut);
+    size_t added = 0;
+    for (const auto &one : elements) {
+      added += insert(one.first, one.second) ? 1 : 0;
+    }
+    return added;
+  }
+
+  // evict the current clock victim
+  void pop() {
+    std::unique_lock<std::shared_mutex> lock(_mut);
+    if (_data_map.empty())
+      return;
+
+    const size_t index = sweep();
+    drop(index);
+    _free.emplace_back(index);
+  }
+
+  [[nodiscard]] size_t size() const {
+    std::shared_lock<std::shared_mutex> lock(_mut);
+    return _data_map.size();
+  }
+};
+
+/*
+ * lock striping: N independent caches, key hash picks the shard
+ * - every shard has its own mutex and its own lru list, so the lru order is
+ *   per shard (approximate globally)
+ * - slice objects are copied into every shard, state shared between shards
+ *   must live behind a pointer/reference inside the slice
+ * - capacity is split evenly: ceil(max_size / shard_count_vv) per shard
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          size_t shard_count_vv = 16, class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
+class sharded_cache {
+  static_assert(shard_count_vv > 0, "shard_count_vv must be greater than 0");
+
+ public:
+  static constexpr size_t shard_size =
+      (max_size + shard_count_vv - 1) / shard_count_vv;
+  using shard_type =
+      cache<key_tt, value_tt, shard_size, hash_tt, key_equal_tt>;
+  using element_type = typename shard_type::element_type;
+
+ private:
+  std::array<std::unique_ptr<shard_type>, shard_count_vv> _shards;
+
+ private:
+  template <class lookup_tt>
+  static size_t shard_index(const lookup_tt &key) {
+    // mix the hash, std::hash of integers is identity on most stdlib
+    const uint64_t h =
+        static_cast<uint64_t>(hash_tt{}(key)) * 0x9e3779b97f4a7c15ull;
+    return (h >> 32) % shard_count_vv;
+  }
+
+  template <class lookup_tt>
+  shard_type &shard(const lookup_tt &key) const {
+    return *_shards[shard_index(key)];
+  }
+
+  // counting sort of [0, count) by shard, offsets[s]..offsets[s + 1] is the
+  // slice of `order` that belongs to shard s
+  template <class key_at_tt>
+  static void group_by_shard(
+      size_t count, key_at_tt &&key_at, std::vector<uint32_t> &order,
+      std::array<uint32_t, shard_count_vv + 1> &offsets) {
+    thread_local std::vector<uint32_t> indexes;
+    indexes.resize(count);
+    offsets.fill(0);
+    for (size_t i = 0; i < count; ++i) {
+      indexes[i] = static_cast<uint32_t>(shard_index(key_at(i)));
+      ++offsets[indexes[i] + 1];
+    }
+    for (size_t s = 0; s < shard_count_vv; ++s) {
+      offsets[s + 1] += offsets[s];
+    }
+    order.resize(count);
+    auto cursor = offsets;
+    for (size_t i = 0; i < count; ++i) {
+      order[cursor[indexes[i]]++] = static_cast<uint32_t>(i);
+    }
+  }
+
+ public:
+  template <class... slice_args>
+  explicit sharded_cache(const slice_args &...sargs) {
+    for (auto &one : _shards) {
+      one = std::make_unique<shard_type>(sargs...);
+    }
+  }
+
+  ~sharded_cache() = default;
+
+  // non-copyable
+  sharded_cache(const sharded_cache &) = delete;
+  sharded_cache(sharded_cache &&) = delete;
+  sharded_cache &operator=(const sharded_cache &) = delete;
+
+  bool add(const key_tt &key, const value_tt &value) {
+    return shard(key).add(key, value);
+  }
+
+  bool add(const key_tt &key, const value_tt &value,
+           typename shard_type::clock_type::duration ttl) {
+    return shard(key).add(key, value, ttl);
+  }
+
+  void rem(const key_tt &key) { shard(key).rem(key); }
+
+  // the value is copied under the shard lock, another thread may evict it
+  // as soon as the lock is released
+  std::optional<value_tt> get(const key_tt &key) {
+    std::optional<value_tt> result;
+    shard(key).get_with(key, [&result](value_tt &value) { result = value; });
+    return result;
+  }
+
+  // fn(value_tt &value) runs under the shard lock on a hit, keep it short
+  template <class fn_tt>
+  bool get_with(const key_tt &key, fn_tt &&fn) {
+    return shard(key).get_with(key, std::forward<fn_tt>(fn));
+  }
+
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  void rem(const lookup_tt &key) {
+    shard(key).rem(key);
+  }
+
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  std::optional<value_tt> get(const lookup_tt &key) {
+    std::optional<value_tt> result;
+    shard(key).get_with(key, [&result](value_tt &value) { result = value; });
+    return result;
+  }
+
+  template <class lookup_tt, class fn_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  bool get_with(const lookup_tt &key, fn_tt &&fn) {
+    return shard(key).get_with(key, std::forward<fn_tt>(fn));
+  }
+
+  template <class loader_tt>
+  value_tt get_or_load(const key_tt &key, loader_tt &&loader) {
+    return shard(key).get_or_load(key, std::forward<loader_tt>(loader));
+  }
+
+  template <class loader_tt, class pool_tt>
+  value_tt get_or_load(const key_tt &key, loader_tt &&loader, pool_tt &pool,
+                       size_t index) {
+    return shard(key).get_or_load(key, std::forward<loader_tt>(loader), pool,
+                                  index);
+  }
+
+  // keys are grouped by shard, every touched shard is locked once
+  // result[i] is a copy of the hit for keys[i] or empty, return hit count
+  size_t multi_get(std::span<const key_tt> keys,
+                   std::span<std::optional<value_tt>> result) {
+    assert(result.size() >= keys.size());
+    thread_local std::vector<uint32_t> order;
+    std::array<uint32_t, shard_count_vv + 1> offsets;
+    group_by_shard(
+        keys.size(), [&keys](size_t i) -> const key_tt & { return keys[i]; },
+        order, offsets);
+
+    size_t hits = 0;
+    for (size_t s = 0; s < shard_count_vv; ++s) {
+      const uint32_t *indexes = order.data() + offsets[s];
+      const size_t count = offsets[s + 1] - offsets[s];
+      if (count == 0)
+        continue;
+      hits += _shards[s]->multi_get_with(
+          count,
+          [&keys, indexes](size_t i) -> const key_tt & {
+            return keys[indexes[i]];
+          },
+          [&result, indexes](size_t i, value_tt *value) {
+            // copied while the shard is still locked
+            if (value != nullptr) {
+              result[indexes[i]] = *value;
+            } else {
+              result[indexes[i]].reset();
+            }
+          });
+    }
+    return hits;
+  }
+
+  // elements are grouped by shard, every touched shard is locked once
+  // return added count
+  size_t multi_put(std::span<const element_type> elements) {
+    thread_local std::vector<uint32_t> order;
+    std::array<uint32_t, shard_count_vv + 1> offsets;
+    group_by_shard(
+        elements.size(),
+        [&elements](size_t i) -> const key_tt & { return elements[i].first; },
+        order, offsets);
+
+    size_t added = 0;
+    for (size_t s = 0; s < shard_count_vv; ++s) {
+      const uint32_t *indexes = order.data() + offsets[s];
+      const size_t count = offsets[s + 1] - offsets[s];
+      if (count == 0)
+        continue;
+      added += _shards[s]->multi_put_with(
+          count,
+          [&elements, indexes](size_t i) -> const element_type & {
+            return elements[indexes[i]];
+          });
+    }
+    return added;
+  }
+
+  size_t tick(typename shard_type::time_point now =
+                  shard_type::clock_type::now()) {
+    size_t count = 0;
+    for (auto &one : _shards) {
+      count += one->tick(now);
+    }
+    return count;
+  }
+
+  // the budget is split evenly between shards
+  void set_max_cost(size_t max_cost,
+                    typename shard_type::cost_function cost_fn) {
+    const size_t shard_cost =
+        max_cost == 0 ? 0
+                      : std::max<size_t>(max_cost / shard_count_vv, 1);
+    for (auto &one : _shards) {
+      one->set_max_cost(shard_cost, cost_fn);
+    }
+  }
+
+  [[nodiscard]] size_t cost() const {
+    size_t result = 0;
+    for (const auto &one : _shards) {
+      result += one->cost();
+    }
+    return result;
+  }
+
+  // one file per shard: path.0 .. path.(shard_count - 1)
+  // load needs the same shard_count and hash as the dump
+  template <class key_codec_tt = pod_codec<key_tt>,
+            class value_codec_tt = pod_codec<value_tt>>
+  bool dump(const std::string &path) const {
+    bool result = true;
+    for (size_t i = 0; i < shard_count_vv; ++i) {
+      result = _shards[i]->template dump<key_codec_tt, value_codec_tt>(
+                   path + "." + std::to_string(i)) &&
+               result;
+    }
+    return result;
+  }
+
+  template <class key_codec_tt = pod_codec<key_tt>,
+            class value_codec_tt = pod_codec<value_tt>>
+  size_t load(const std::string &path) {
+    size_t count = 0;
+    for (size_t i = 0; i < shard_count_vv; ++i) {
+      count += _shards[i]->template load<key_codec_tt, value_codec_tt>(
+          path + "." + std::to_string(i));
+    }
+    return count;
+  }
+};
+
+};  // namespace easy::lru
+
+/* benchmark code
+
+static void lru_cache_mixed(benchmark::State &state) {
+  static easy::lru::cache<uint64_t, uint64_t, 100000> c;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 200000;
+    if (key & 3) {
+      benchmark::DoNotOptimize(c.get(key));
+    } else {
+      c.add(key, key);
+    }
+  }
+}
+
+static void lru_sharded_cache_mixed(benchmark::State &state) {
+  static easy::lru::sharded_cache<uint64_t, uint64_t, 100000, 64> c;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 200000;
+    if (key & 3) {
+      benchmark::DoNotOptimize(c.get(key));
+    } else {
+      c.add(key, key);
+    }
+  }
+}
+
+static void lru_flat_cache_mixed(benchmark::State &state) {
+  static easy::lru::flat_cache<uint64_t, uint64_t, 100000> c;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 200000;
+    if (key & 3) {
+      benchmark::DoNotOptimize(c.get(key));
+    } else {
+      c.add(key, key);
+    }
+  }
+}
+
+BENCHMARK(lru_cache_mixed)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(lru_sharded_cache_mixed)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(lru_flat_cache_mixed);
+
+static void lru_cache_read_heavy(benchmark::State &state) {
+  static easy::lru::cache<uint64_t, uint64_t, 100000> c;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 120000;
+    if (key % 64 == 0) {
+      c.add(key, key);
+    } else {
+      benchmark::DoNotOptimize(c.get(key));
+    }
+  }
+}
+
+static void lru_clock_cache_read_heavy(benchmark::State &state) {
+  static easy::lru::clock_cache<uint64_t, uint64_t, 100000> c;
+  uint32_t seed = lcg_seed(12345 + state.thread_index());
+  for (auto _ : state) {
+    uint64_t key = lcg_rand(seed) % 120000;
+    if (key % 64 == 0) {
+      c.add(key, key);
+    } else {
+      benchmark::DoNotOptimize(c.get(key));
+    }
+  }
+}
+
+BENCHMARK(lru_cache_read_heavy)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK(lru_clock_cache_read_heavy)->ThreadRange(1, 32)->UseRealTime();
+
+*/
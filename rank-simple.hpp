@@ -1,62 +1,370 @@
 #pragma once
-#include <map>
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "endianness.h"
 
 namespace rank {
 
+// serialize / unserialize are container members, only boards whose fields
+// all have a codec<> get them
 class container_interface {
  public:
   virtual ~container_interface() = default;
-  // todo:
-  // virtual std::string serialize() = 0;
-  // virtual std::string unserialize() = 0;
 };
 
+/*
+ * binary codec of one field, little endian on the wire
+ * specialize it for sort keys and elements:
+ *   static void write(std::string& out, const tt& value);
+ *   static bool read(std::string_view& in, tt& value);  // consumes, false
+ *                                                       // on short input
+ */
+template <class tt, class = void>
+struct codec;
+
+template <class tt>
+concept has_codec = requires(std::string& out, std::string_view& in,
+                             const tt& value, tt& target) {
+  codec<tt>::write(out, value);
+  { codec<tt>::read(in, target) } -> std::convertible_to<bool>;
+};
+
+template <class tt>
+struct codec<tt, std::enable_if_t<std::is_integral_v<tt>>> {
+  using wire_type = std::conditional_t<
+      sizeof(tt) == 1, uint8_t,
+      std::conditional_t<sizeof(tt) == 2, uint16_t,
+                         std::conditional_t<sizeof(tt) == 4, uint32_t,
+                                            uint64_t>>>;
+  static_assert(sizeof(tt) == sizeof(wire_type), "unsupported integer size");
+
+  static void write(std::string& out, const tt& value) {
+    char buffer[sizeof(wire_type)];
+    endianness::le_write(static_cast<wire_type>(value), buffer);
+    out.append(buffer, sizeof(buffer));
+  }
+
+  static bool read(std::string_view& in, tt& value) {
+    if (in.size() < sizeof(wire_type))
+      return false;
+    wire_type wire = 0;
+    endianness::le_read(in.data(), wire);
+    value = static_cast<tt>(wire);
+    in.remove_prefix(sizeof(wire_type));
+    return true;
+  }
+};
+
+// u32 length + bytes
+template <>
+struct codec<std::string> {
+  static void write(std::string& out, const std::string& value) {
+    codec<uint32_t>::write(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+  }
+
+  static bool read(std::string_view& in, std::string& value) {
+    uint32_t size = 0;
+    if (!codec<uint32_t>::read(in, size) || in.size() < size)
+      return false;
+    value.assign(in.data(), size);
+    in.remove_prefix(size);
+    return true;
+  }
+};
+
+/*
+ * fixed width sort key, fields packed most significant first
+ * a plain integer compare (hi, then lo) is the whole comparator
+ */
+struct packed_key {
+  uint64_t hi = 0;
+  uint64_t lo = 0;
+
+  friend auto operator<=>(const packed_key&, const packed_key&) = default;
+};
+
+template <>
+struct codec<packed_key> {
+  static void write(std::string& out, const packed_key& value) {
+    codec<uint64_t>::write(out, value.hi);
+    codec<uint64_t>::write(out, value.lo);
+  }
+
+  static bool read(std::string_view& in, packed_key& value) {
+    return codec<uint64_t>::read(in, value.hi) &&
+           codec<uint64_t>::read(in, value.lo);
+  }
+};
+
+struct sort_field {
+  std::string name;
+  bool descending = false;
+  uint8_t bits = 32;      // 1 - 64
+  bool is_signed = true;  // [-2^(bits-1), 2^(bits-1)), else [0, 2^bits)
+};
+
+/*
+ * compiles a runtime sort spec (eg. from lua / config) into packed_key
+ * - every field takes `bits` bits, the first field the highest ones
+ * - a signed field is biased by 2^(bits-1) so negatives order correctly, a
+ *   descending field is stored inverted so ascending packed_key order is the
+ *   spec order
+ * - a value outside its field's range fails the whole pack (nullopt), two
+ *   distinct values never share a packed key
+ * - field names are resolved once per pack, never per compare
+ */
+class sort_spec {
+  struct slot {
+    std::string name;
+    bool descending = false;
+    uint8_t bits = 0;
+    uint8_t shift = 0;  // lowest bit in the 128 bit key
+    bool is_signed = false;
+  };
+
+ private:
+  std::vector<slot> _slots;
+
+ private:
+  static void place(packed_key& key, uint64_t value, uint8_t shift,
+                    uint8_t bits) {
+    if (shift >= 64) {
+      key.hi |= value << (shift - 64);
+      return;
+    }
+    key.lo |= value << shift;
+    if (shift + bits > 64) {
+      key.hi |= value >> (64 - shift);
+    }
+  }
+
+ public:
+  // false (spec left empty) when a width is outside 1 - 64 or the sum > 128
+  bool compile(const std::vector<sort_field>& fields) {
+    _slots.clear();
+    std::size_t used = 0;
+    for (const auto& one : fields) {
+      if (one.bits == 0 || one.bits > 64 || used + one.bits > 128) {
+        _slots.clear();
+        return false;
+      }
+      used += one.bits;
+      _slots.push_back(slot{one.name, one.descending, one.bits,
+                            static_cast<uint8_t>(128 - used), one.is_signed});
+    }
+    return true;
+  }
+
+  [[nodiscard]] std::size_t size() const { return _slots.size(); }
+
+  // values in field order, missing trailing values are 0
+  // nullopt when a value is outside its field's range
+  [[nodiscard]] std::optional<packed_key> pack(
+      std::span<const int64_t> values) const {
+    packed_key result;
+    for (std::size_t i = 0; i < _slots.size(); ++i) {
+      const auto& one = _slots[i];
+      const uint64_t max =
+          one.bits == 64 ? ~uint64_t(0) : (uint64_t(1) << one.bits) - 1;
+      const int64_t raw = i < values.size() ? values[i] : 0;
+      uint64_t value = static_cast<uint64_t>(raw);
+      if (one.is_signed) {
+        // bias, -2^(bits-1) -> 0; out of range iff the biased value > max
+        value += uint64_t(1) << (one.bits - 1);
+        if (one.bits < 64 && value > max)
+          return std::nullopt;
+      } else if (raw < 0 || value > max) {
+        return std::nullopt;
+      }
+      if (one.descending)
+        value = max - value;
+      place(result, value, one.shift, one.bits);
+    }
+    return result;
+  }
+
+  // fields looked up by name, missing ones are 0
+  [[nodiscard]] std::optional<packed_key> pack(
+      const std::unordered_map<std::string, int64_t>& keys) const {
+    std::array<int64_t, 128> values{};
+    for (std::size_t i = 0; i < _slots.size(); ++i) {
+      if (const auto it = keys.find(_slots[i].name); it != keys.end())
+        values[i] = it->second;
+    }
+    return pack(std::span<const int64_t>(values.data(), _slots.size()));
+  }
+};
+
+/*
+ * stable lsd radix sort by packed_key, ascending
+ * - 8 bit digits, a digit every item shares is skipped, so a spec using
+ *   40 bits costs at most 5 passes, O(passes * n), no comparisons
+ * - tt must be default constructible and movable
+ */
+template <class tt, class key_of_tt>
+void radix_sort(std::vector<tt>& items, key_of_tt&& key_of) {
+  constexpr std::size_t digits = 16;
+  auto digit = [](const packed_key& key, std::size_t d) -> std::size_t {
+    return d < 8 ? (key.lo >> (d * 8)) & 0xff
+                 : (key.hi >> ((d - 8) * 8)) & 0xff;
+  };
+
+  std::vector<std::array<std::size_t, 256>> counts(digits);
+  for (const auto& one : items) {
+    const packed_key key = key_of(one);
+    for (std::size_t d = 0; d < digits; ++d) {
+      ++counts[d][digit(key, d)];
+    }
+  }
+
+  std::vector<tt> buffer(items.size());
+  for (std::size_t d = 0; d < digits; ++d) {
+    auto& count = counts[d];
+    if (std::find(count.begin(), count.end(), items.size()) != count.end())
+      continue;
+
+    std::size_t offset = 0;
+    for (auto& c : count) {
+      offset += std::exchange(c, offset);
+    }
+    for (auto& one : items) {
+      auto& at = count[digit(key_of(one), d)];
+      buffer[at++] = std::move(one);
+    }
+    items.swap(buffer);
+  }
+}
+
+/*
+ * bounded board, the best count_vv elements by compare_tt
+ * - rows live in one sorted array reserved to count_vv up front, insert is a
+ *   binary search plus a shift of at most count_vv rows, no node allocation
+ * - once full, the last row is the cut-off: a new element that does not beat
+ *   it is rejected before anything is touched
+ */
 template <std::size_t count_vv, class sort_key_tt, class element_tt,
           class element_key_tt, class compare_tt = std::less<sort_key_tt> >
 class container : public container_interface {
-  using sort_data =
-      std::map<sort_key_tt, std::pair<element_key_tt, element_tt>, compare_tt>;
+  static_assert(count_vv > 0, "empty board");
+
+  struct row {
+    sort_key_tt skey;
+    element_key_tt ekey;
+    element_tt ev;
+  };
+  using sort_data = std::vector<row>;
   using sort_data_iterator = typename sort_data::iterator;
 
+ public:
+  // ranks are bounded by count_vv
+  using rank_type = uint32_t;
+  static constexpr rank_type not_exist_rank = 0;
+
+  struct rank_change {
+    element_key_tt ekey;
+    rank_type old_rank;  // not_exist_rank: entered the board
+    rank_type new_rank;  // not_exist_rank: left the board
+  };
+
  private:
   const std::size_t _count = count_vv;
+  compare_tt _compare;
   sort_data _data;
-  std::unordered_map<element_key_tt, sort_data_iterator> _elements;
+  std::unordered_map<element_key_tt, sort_key_tt> _elements;
   std::unordered_set<element_key_tt> _dirty_elements;
 
+  // ranks as of the last drain_changes; rows before _dirty_from have not
+  // moved since, every insert / remove only shifts the rows behind it
+  std::unordered_map<element_key_tt, rank_type> _drained;
+  std::size_t _dirty_from = count_vv;
+
+ private:
+  std::size_t position(const sort_key_tt& skey) const {
+    return std::lower_bound(_data.begin(), _data.end(), skey,
+                            [this](const row& one, const sort_key_tt& k) {
+                              return _compare(one.skey, k);
+                            }) -
+           _data.begin();
+  }
+
+  sort_data_iterator lower_bound(const sort_key_tt& skey) {
+    return _data.begin() + position(skey);
+  }
+
+  void touch(std::size_t at) { _dirty_from = std::min(_dirty_from, at); }
+
+  // current ranks become the drained ones, nothing to report
+  void rebase() {
+    _drained.clear();
+    for (std::size_t i = 0; i < _data.size(); ++i) {
+      _drained.emplace(_data[i].ekey, static_cast<rank_type>(i + 1));
+    }
+    _dirty_elements.clear();
+    _dirty_from = _count;
+  }
+
+  // not full, or skey sorts before the current last row
+  bool qualify(const sort_key_tt& skey) const {
+    return _data.size() < _count || _compare(skey, _data.back().skey);
+  }
+
  public:
-  container() = default;
+  container() { _data.reserve(count_vv); }
 
-  container(compare_tt&& compare_call) : _data(compare_call) {}
+  container(compare_tt&& compare_call) : _compare(std::move(compare_call)) {
+    _data.reserve(count_vv);
+  }
 
   ~container() override = default;
 
   [[maybe_unused]] bool insert(const sort_key_tt& skey, const element_tt& ev, const element_key_tt& ekey) {
+    if (!qualify(skey) && !_elements.contains(ekey))
+      return false;
+
     remove(ekey);
 
-    if (auto [data_it, res] = _data.emplace(skey, std::make_pair(ekey, ev));
-        res) {
-      if (auto [ele_it, res] = _elements.emplace(ekey, data_it); res) {
-        _dirty_elements.emplace(ekey);
-      }
-    }
+    // an index, not an iterator: pop_back below invalidates iterators
+    const std::size_t at = position(skey);
+    if (at < _data.size() && !_compare(skey, _data[at].skey))
+      return false;  // same sort key already on the board
 
-    while (_data.size() > _count) {
-      auto last_data_it = std::prev(_data.end());
-      remove(last_data_it->second.first);
+    if (_data.size() == _count) {
+      if (at == _data.size())
+        return false;  // would be the row trimmed right away
+      _dirty_elements.emplace(_data.back().ekey);
+      _elements.erase(_data.back().ekey);
+      _data.pop_back();
     }
 
-    return exist(ekey);
+    touch(at);
+    _data.insert(_data.begin() + at, row{skey, ekey, ev});
+    _elements.emplace(ekey, skey);
+    _dirty_elements.emplace(ekey);
+    return true;
   }
 
   [[maybe_unused]] bool remove(const element_key_tt& ekey) {
     if (const auto it = _elements.find(ekey); it != _elements.end()) {
       _dirty_elements.emplace(ekey);
 
-      _data.erase(it->second);
+      const auto at = lower_bound(it->second);
+      touch(at - _data.begin());
+      _data.erase(at);
       _elements.erase(it);
       return true;
     }
@@ -66,6 +374,123 @@ class container : public container_interface {
   bool exist(const element_key_tt& ekey) const {
     return _elements.contains(ekey);
   }
+
+  // 1-based, not_exist_rank when off the board, O(log count_vv)
+  [[nodiscard]] rank_type rank(const element_key_tt& ekey) const {
+    if (const auto it = _elements.find(ekey); it != _elements.end())
+      return static_cast<rank_type>(position(it->second) + 1);
+    return not_exist_rank;
+  }
+
+  /*
+   * rank moves since the last drain, eg. to broadcast only what moved
+   * - only rows from the lowest touched position on are compared with the
+   *   drained ranks, plus the dirty elements that left the board
+   * - an element that entered and left in between is not reported
+   * - on-board changes come first in rank order, then departures
+   */
+  std::vector<rank_change> drain_changes() {
+    std::vector<rank_change> result;
+    for (std::size_t i = _dirty_from; i < _data.size(); ++i) {
+      const auto rank = static_cast<rank_type>(i + 1);
+      auto [it, entered] = _drained.try_emplace(_data[i].ekey, rank);
+      if (entered) {
+        result.push_back({_data[i].ekey, not_exist_rank, rank});
+      } else if (it->second != rank) {
+        result.push_back({_data[i].ekey, it->second, rank});
+        it->second = rank;
+      }
+    }
+
+    for (const auto& ekey : _dirty_elements) {
+      if (_elements.contains(ekey))
+        continue;
+      if (const auto it = _drained.find(ekey); it != _drained.end()) {
+        result.push_back({ekey, it->second, not_exist_rank});
+        _drained.erase(it);
+      }
+    }
+
+    _dirty_elements.clear();
+    _dirty_from = _count;
+    return result;
+  }
+
+  /*
+   * snapshot: magic, count (u32), then count * (sort key, element key,
+   * element) in sort order, every field through codec<>
+   */
+  std::string serialize() const
+    requires has_codec<sort_key_tt> && has_codec<element_key_tt> &&
+             has_codec<element_tt>
+  {
+    std::string out;
+    codec<uint32_t>::write(out, snapshot_magic);
+    codec<uint32_t>::write(out, static_cast<uint32_t>(_data.size()));
+    for (const auto& one : _data) {
+      codec<sort_key_tt>::write(out, one.skey);
+      codec<element_key_tt>::write(out, one.ekey);
+      codec<element_tt>::write(out, one.ev);
+    }
+    return out;
+  }
+
+  // the snapshot is already sorted: every row is appended at the back,
+  // O(n) in total instead of n binary searches; unsorted input still loads
+  // a loaded board is the new drain baseline
+  // false: bad / truncated data, the container is left empty
+  bool unserialize(std::string_view data)
+    requires has_codec<sort_key_tt> && has_codec<element_key_tt> &&
+             has_codec<element_tt>
+  {
+    clear();
+
+    uint32_t magic = 0;
+    uint32_t count = 0;
+    if (!codec<uint32_t>::read(data, magic) || magic != snapshot_magic ||
+        !codec<uint32_t>::read(data, count)) {
+      return false;
+    }
+
+    _elements.reserve(std::min<std::size_t>(count, _count));
+    for (uint32_t i = 0; i < count; ++i) {
+      sort_key_tt skey{};
+      element_key_tt ekey{};
+      element_tt ev{};
+      if (!codec<sort_key_tt>::read(data, skey) ||
+          !codec<element_key_tt>::read(data, ekey) ||
+          !codec<element_tt>::read(data, ev)) {
+        clear();
+        return false;
+      }
+
+      if (_data.empty() || _compare(_data.back().skey, skey)) {
+        if (_data.size() >= _count || _elements.contains(ekey))
+          continue;
+        _elements.emplace(ekey, skey);
+        _data.push_back(row{std::move(skey), std::move(ekey), std::move(ev)});
+      } else {
+        insert(skey, ev, ekey);
+      }
+    }
+    rebase();
+    return true;
+  }
+
+  // the removed rows still show up in the next drain_changes
+  void clear() {
+    for (const auto& one : _data) {
+      _dirty_elements.emplace(one.ekey);
+    }
+    touch(0);
+    _data.clear();
+    _elements.clear();
+  }
+
+  [[nodiscard]] std::size_t size() const { return _data.size(); }
+
+ private:
+  static constexpr uint32_t snapshot_magic = 0x314b4e52;  // "RNK1"
 };
 
 }; // namespace rank
@@ -128,6 +553,11 @@ for (int i = 0; i < 100; ++i) {
   rcg.insert(sk, ev, i);
 }
 
+// every broadcast tick: only what moved, {ekey, old_rank, new_rank}
+for (const auto& one : rc.drain_changes()) {
+  // send one.ekey, one.old_rank, one.new_rank
+}
+
 namespace lua_rank_test {
 
 struct sort_key {
@@ -155,3 +585,20 @@ auto lua_comp = [compares](const lua_rank_test::sort_key& left,
 rank::container<10, rank_test::sort_key, rank_test::element_value,
                 rank_test::element_key, decltype(lua_comp)>
     rcl(lua_comp);
+
+// same spec compiled once: fields are looked up when a key is packed, the
+// comparator is one 128 bit integer compare
+rank::sort_spec spec;
+spec.compile({{"level", true, 16, false}, {"exp", true, 48, false}});
+
+rank::container<10, rank::packed_key, rank_test::element_value,
+                rank_test::element_key>
+    rcp;
+
+if (auto key = spec.pack(std::unordered_map<std::string, int64_t>{
+        {"level", 10}, {"exp", 500}})) {
+  rcp.insert(*key, {"name_1"}, 1);
+}
+
+std::vector<std::pair<rank::packed_key, rank_test::element_key>> rows;
+rank::radix_sort(rows, [](const auto& one) { return one.first; });
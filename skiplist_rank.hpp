@@ -0,0 +1,453 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace util {
+
+namespace skiplist_rank {
+
+/*
+ * redis zset style skiplist
+ * - ordered by (score, element key), rank 1 is the lowest
+ * - every forward link stores its span (level 0 nodes it skips), so rank and
+ *   "n-th node" are summed / consumed while walking down the levels
+ * - a node is one allocation: the header plus `height` levels right after it
+ * - insert / erase / rank / range / range_by_score are O(log n) (+ output)
+ */
+template <class score_tt, class element_key_tt,
+          class score_compare_tt = std::less<std::decay_t<score_tt>>,
+          class key_compare_tt = std::less<std::decay_t<element_key_tt>>>
+class container {
+ public:
+  using score_type = std::decay_t<score_tt>;
+  using element_key_type = std::decay_t<element_key_tt>;
+
+  using rank_type = uint64_t;
+  static constexpr rank_type not_exist_rank = 0;
+
+  static constexpr int max_level = 32;
+
+ private:
+  struct node;
+
+  struct level {
+    node* forward = nullptr;
+    rank_type span = 0;
+  };
+
+  struct node {
+    score_type score;
+    element_key_type key;
+    node* backward = nullptr;
+    int height = 0;
+
+    level* levels() { return reinterpret_cast<level*>(this + 1); }
+
+    static node* create(int height, const score_type& score,
+                        const element_key_type& key) {
+      void* memory = ::operator new(sizeof(node) + sizeof(level) * height);
+      auto* result = new (memory) node{score, key, nullptr, height};
+      for (int i = 0; i < height; ++i) {
+        new (result->levels() + i) level{};
+      }
+      return result;
+    }
+
+    static void destroy(node* n) {
+      n->~node();
+      ::operator delete(n);
+    }
+  };
+  static_assert(sizeof(node) % alignof(level) == 0,
+                "levels follow the node header");
+
+  using element2node = std::unordered_map<element_key_type, node*>;
+
+ private:
+  node* _header = nullptr;
+  node* _tail = nullptr;
+  int _level = 1;
+  rank_type _length = 0;
+  uint64_t _random = 0x2545f4914f6cdd1dull;
+
+  element2node _e2n;
+
+ private:
+  // (score, key) of a sorts before (score, key)
+  static bool less(const node* a, const score_type& score,
+                   const element_key_type& key) {
+    if (score_compare_tt{}(a->score, score))
+      return true;
+    if (score_compare_tt{}(score, a->score))
+      return false;
+    return key_compare_tt{}(a->key, key);
+  }
+
+  // p = 1/4 per extra level, same as redis
+  int random_level() {
+    _random ^= _random << 13;
+    _random ^= _random >> 7;
+    _random ^= _random << 17;
+    int result = 1;
+    for (uint64_t bits = _random; result < max_level && (bits & 3) == 0;
+         bits >>= 2) {
+      ++result;
+    }
+    return result;
+  }
+
+  node* link(const score_type& score, const element_key_type& key) {
+    node* update[max_level];
+    rank_type rank[max_level];
+
+    node* x = _header;
+    for (int i = _level - 1; i >= 0; --i) {
+      rank[i] = i == _level - 1 ? 0 : rank[i + 1];
+      while (x->levels()[i].forward &&
+             less(x->levels()[i].forward, score, key)) {
+        rank[i] += x->levels()[i].span;
+        x = x->levels()[i].forward;
+      }
+      update[i] = x;
+    }
+
+    const int height = random_level();
+    if (height > _level) {
+      for (int i = _level; i < height; ++i) {
+        rank[i] = 0;
+        update[i] = _header;
+        update[i]->levels()[i].span = _length;
+      }
+      _level = height;
+    }
+
+    x = node::create(height, score, key);
+    for (int i = 0; i < height; ++i) {
+      auto& prev = update[i]->levels()[i];
+      x->levels()[i].forward = prev.forward;
+      prev.forward = x;
+      x->levels()[i].span = prev.span - (rank[0] - rank[i]);
+      prev.span = (rank[0] - rank[i]) + 1;
+    }
+    for (int i = height; i < _level; ++i) {
+      update[i]->levels()[i].span++;
+    }
+
+    x->backward = update[0] == _header ? nullptr : update[0];
+    if (x->levels()[0].forward) {
+      x->levels()[0].forward->backward = x;
+    } else {
+      _tail = x;
+    }
+    ++_length;
+    return x;
+  }
+
+  void unlink(node* target) {
+    node* update[max_level];
+    node* x = _header;
+    for (int i = _level - 1; i >= 0; --i) {
+      while (x->levels()[i].forward &&
+             less(x->levels()[i].forward, target->score, target->key)) {
+        x = x->levels()[i].forward;
+      }
+      update[i] = x;
+    }
+
+    for (int i = 0; i < _level; ++i) {
+      auto& prev = update[i]->levels()[i];
+      if (prev.forward == target) {
+        prev.span += target->levels()[i].span - 1;
+        prev.forward = target->levels()[i].forward;
+      } else {
+        prev.span -= 1;
+      }
+    }
+    if (target->levels()[0].forward) {
+      target->levels()[0].forward->backward = target->backward;
+    } else {
+      _tail = target->backward;
+    }
+    while (_level > 1 && _header->levels()[_level - 1].forward == nullptr) {
+      --_level;
+    }
+    --_length;
+    node::destroy(target);
+  }
+
+  // node of the 1-based rank, nullptr when out of range
+  node* first_not_below(const score_type& min) const {
+    node* x = _header;
+    for (int i = _level - 1; i >= 0; --i) {
+      while (x->levels()[i].forward &&
+             score_compare_tt{}(x->levels()[i].forward->score, min)) {
+        x = x->levels()[i].forward;
+      }
+    }
+    return x->levels()[0].forward;
+  }
+
+  node* at(rank_type rank) const {
+    if (rank == 0 || rank > _e2n.size())
+      return nullptr;
+
+    rank_type traversed = 0;
+    node* x = _header;
+    for (int i = _level - 1; i >= 0; --i) {
+      while (x->levels()[i].forward &&
+             traversed + x->levels()[i].span <= rank) {
+        traversed += x->levels()[i].span;
+        x = x->levels()[i].forward;
+      }
+      if (traversed == rank)
+        return x;
+    }
+    return nullptr;
+  }
+
+ public:
+  explicit container() {
+    _header = node::create(max_level, score_type{}, element_key_type{});
+  }
+
+  ~container() {
+    node* x = _header->levels()[0].forward;
+    while (x) {
+      node* next = x->levels()[0].forward;
+      node::destroy(x);
+      x = next;
+    }
+    node::destroy(_header);
+  }
+
+  container(const container&) = delete;
+  container& operator=(const container&) = delete;
+
+ public:
+  // insert or move ek to score
+  [[maybe_unused]] bool insert(const score_type& k,
+                               const element_key_type& ek) {
+    if (const auto it = _e2n.find(ek); it != _e2n.end()) {
+      node* x = it->second;
+      // still between its neighbours: update in place, like zadd
+      const node* next = x->levels()[0].forward;
+      if ((x->backward == nullptr || less(x->backward, k, ek)) &&
+          (next == nullptr || !less(next, k, ek))) {
+        x->score = k;
+        return true;
+      }
+      unlink(x);
+      it->second = link(k, ek);
+      return true;
+    }
+
+    _e2n.emplace(ek, link(k, ek));
+    return true;
+  }
+
+  [[maybe_unused]] bool erase(const element_key_type& ek) {
+    if (const auto it = _e2n.find(ek); it != _e2n.end()) {
+      node* x = it->second;
+      _e2n.erase(it);
+      unlink(x);
+      return true;
+    }
+    return false;
+  }
+
+  [[nodiscard]] std::size_t size() const { return _e2n.size(); }
+
+  [[nodiscard]] rank_type rank(const element_key_type& ek) const {
+    const auto it = _e2n.find(ek);
+    if (it == _e2n.end())
+      return not_exist_rank;
+
+    const node* target = it->second;
+    rank_type result = 0;
+    node* x = _header;
+    for (int i = _level - 1; i >= 0; --i) {
+      while (x->levels()[i].forward &&
+             (x->levels()[i].forward == target ||
+              less(x->levels()[i].forward, target->score, target->key))) {
+        result += x->levels()[i].span;
+        x = x->levels()[i].forward;
+      }
+      if (x == target)
+        return result;
+    }
+    return not_exist_rank;
+  }
+
+  // rank counted from the highest score
+  [[nodiscard]] rank_type revrank(const element_key_type& ek) const {
+    const rank_type result = rank(ek);
+    return result == not_exist_rank ? not_exist_rank
+                                    : _e2n.size() - result + 1;
+  }
+
+  [[nodiscard]] std::optional<score_type> score(
+      const element_key_type& ek) const {
+    if (const auto it = _e2n.find(ek); it != _e2n.end()) {
+      return it->second->score;
+    }
+    return std::nullopt;
+  }
+
+  // elements ordered before (k, ek), ek does not need to be in the list
+  [[nodiscard]] rank_type count_less(const score_type& k,
+                                     const element_key_type& ek) const {
+    rank_type result = 0;
+    node* x = _header;
+    for (int i = _level - 1; i >= 0; --i) {
+      while (x->levels()[i].forward && less(x->levels()[i].forward, k, ek)) {
+        result += x->levels()[i].span;
+        x = x->levels()[i].forward;
+      }
+    }
+    return result;
+  }
+
+  // ascending walk over level 0, invalidated by insert / erase
+  class cursor {
+   public:
+    explicit operator bool() const { return _node != nullptr; }
+    const score_type& score() const { return _node->score; }
+    const element_key_type& key() const { return _node->key; }
+    void next() { _node = _node->levels()[0].forward; }
+
+   private:
+    friend class container;
+    explicit cursor(node* n) : _node(n) {}
+
+    node* _node = nullptr;
+  };
+
+  // cursor at rank, 1-based, empty when out of range
+  [[nodiscard]] cursor seek(rank_type rank) const { return cursor{at(rank)}; }
+
+  // cursor at the first score not below min, empty when there is none
+  [[nodiscard]] cursor seek_score(const score_type& min) const {
+    return cursor{first_not_below(min)};
+  }
+
+  // fn(score, element_key) for ranks [l, r], 1-based, inclusive
+  template <class fn_tt>
+  void visit(rank_type l, rank_type r, fn_tt&& fn) const {
+    if (l == 0)
+      l = 1;
+    for (node* x = at(l); l <= r && x; ++l, x = x->levels()[0].forward) {
+      fn(x->score, x->key);
+    }
+  }
+
+  // fn(score, element_key) for scores in [min, max], ascending
+  template <class fn_tt>
+  void visit_by_score(const score_type& min, const score_type& max,
+                      fn_tt&& fn) const {
+    for (node* x = first_not_below(min);
+         x && !score_compare_tt{}(max, x->score); x = x->levels()[0].forward) {
+      fn(x->score, x->key);
+    }
+  }
+
+  // ranks [l, r], 1-based, inclusive
+  std::vector<element_key_type> range(rank_type l, rank_type r) const {
+    std::vector<element_key_type> result{};
+    if (l == 0)
+      l = 1;
+    if (r > _e2n.size())
+      r = _e2n.size();
+    if (r < l)
+      return result;
+
+    result.reserve(r - l + 1);
+    visit(l, r, [&result](const score_type&, const element_key_type& ek) {
+      result.emplace_back(ek);
+    });
+    return result;
+  }
+
+  // scores in [min, max], ascending
+  std::vector<element_key_type> range_by_score(const score_type& min,
+                                               const score_type& max) const {
+    std::vector<element_key_type> result{};
+    visit_by_score(min, max,
+                   [&result](const score_type&, const element_key_type& ek) {
+                     result.emplace_back(ek);
+                   });
+    return result;
+  }
+};
+
+}  // namespace skiplist_rank
+
+}  // namespace util
+
+/* benchmark code: same data as splitter_sort.hpp
+
+static void add_skiplist_rank(benchmark::State &state) {
+  static util::skiplist_rank::container<uint32_t, uint64_t> slr;
+  uint32_t seed = lcg_seed(12345);
+  for (auto _ : state) {
+    uint32_t score = lcg_rand(seed) % 1000;
+    auto uuid = util::uuid_snowflake::generator::inst().nextid();
+    slr.insert(score, uuid);
+  }
+}
+
+static std::vector<uint64_t> add_skiplist_rank(
+    util::skiplist_rank::container<uint32_t, uint64_t> &slr, int count) {
+  std::vector<uint64_t> result;
+  result.reserve(count);
+  uint32_t seed = lcg_seed(12345);
+  for (auto i = 0; i < count; ++i) {
+    uint32_t score = lcg_rand(seed) % 1000;
+    auto uuid = util::uuid_snowflake::generator::inst().nextid();
+    slr.insert(score, uuid);
+    result.emplace_back(uuid);
+  }
+  return result;
+}
+
+static void rank_skiplist_rank(benchmark::State &state) {
+  static util::skiplist_rank::container<uint32_t, uint64_t> slr;
+
+  int count = 1000000 / 10;
+  auto uuids = add_skiplist_rank(slr, count);
+
+  for (auto _ : state) {
+    if (uuids.empty())
+      break;
+    auto uid = uuids.back();
+    uuids.pop_back();
+    auto __ = slr.rank(uid);
+  }
+}
+
+static void range_skiplist_rank(benchmark::State &state) {
+  static util::skiplist_rank::container<uint32_t, uint64_t> slr;
+  add_skiplist_rank(slr, 1000000 / 10);
+
+  uint32_t seed = lcg_seed(12345);
+  for (auto _ : state) {
+    auto l = lcg_rand(seed) % slr.size() + 1;
+    benchmark::DoNotOptimize(slr.range(l, l + 99));
+  }
+}
+
+// add_splitter_sorter / rank_splitter_sorter and the container2 versions
+// are in splitter_sort.hpp
+BENCHMARK(add_splitter_sorter);
+BENCHMARK(add_splitter_sorter2);
+BENCHMARK(add_skiplist_rank);
+BENCHMARK(rank_splitter_sorter);
+BENCHMARK(rank_splitter_sorter2);
+BENCHMARK(rank_skiplist_rank);
+BENCHMARK(range_skiplist_rank);
+
+*/
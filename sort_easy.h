@@ -1,8 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
 #include <iterator>
-#include <map>
 #include <memory>
+#include <span>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace sort {
 
@@ -15,6 +21,272 @@ namespace sort {
     template <typename T>
     constexpr bool is_std_hash_able_v = is_std_hash_able<T>::value;
 
+    /*
+     * avl tree of score buckets (order statistic tree)
+     * - every node keeps the element count (sum of bucket sizes) and the
+     *   bucket count of its subtree, so "elements before a bucket" and
+     *   "the n-th bucket" are one walk between a node and the root
+     * - nodes never move in memory, callers may keep node pointers until
+     *   the node is erased
+     */
+    template <class _Score, class _Bucket, class _Compare = std::less<_Score>>
+    class rank_tree final {
+    public:
+        using compare_type = _Compare;
+
+        struct node {
+            _Score score;
+            _Bucket bucket;
+
+            node* parent = nullptr;
+            node* left = nullptr;
+            node* right = nullptr;
+            int height = 1;
+            size_t elements = 0;
+            size_t buckets = 1;
+        };
+
+    private:
+        node* _root = nullptr;
+
+    private:
+        static int height_of(const node* n) { return n ? n->height : 0; }
+        static size_t elements_of(const node* n) { return n ? n->elements : 0; }
+        static size_t buckets_of(const node* n) { return n ? n->buckets : 0; }
+
+        static void update(node* n) {
+            n->height = 1 + std::max(height_of(n->left), height_of(n->right));
+            n->elements = n->bucket.size() + elements_of(n->left) + elements_of(n->right);
+            n->buckets = 1 + buckets_of(n->left) + buckets_of(n->right);
+        }
+
+        // v takes u's place under u's parent
+        void replace(node* u, node* v) {
+            if (!u->parent) {
+                _root = v;
+            } else if (u == u->parent->left) {
+                u->parent->left = v;
+            } else {
+                u->parent->right = v;
+            }
+            if (v) {
+                v->parent = u->parent;
+            }
+        }
+
+        node* rotate_left(node* x) {
+            node* y = x->right;
+            x->right = y->left;
+            if (y->left) {
+                y->left->parent = x;
+            }
+            replace(x, y);
+            y->left = x;
+            x->parent = y;
+            update(x);
+            update(y);
+            return y;
+        }
+
+        node* rotate_right(node* x) {
+            node* y = x->left;
+            x->left = y->right;
+            if (y->right) {
+                y->right->parent = x;
+            }
+            replace(x, y);
+            y->right = x;
+            x->parent = y;
+            update(x);
+            update(y);
+            return y;
+        }
+
+        // fix counts and balance from n up to the root
+        void rebalance(node* n) {
+            while (n) {
+                update(n);
+                const int balance = height_of(n->left) - height_of(n->right);
+                if (balance > 1) {
+                    if (height_of(n->left->left) < height_of(n->left->right)) {
+                        rotate_left(n->left);
+                    }
+                    n = rotate_right(n);
+                } else if (balance < -1) {
+                    if (height_of(n->right->right) < height_of(n->right->left)) {
+                        rotate_right(n->right);
+                    }
+                    n = rotate_left(n);
+                }
+                n = n->parent;
+            }
+        }
+
+        static void destroy(node* n) {
+            if (!n) return;
+            destroy(n->left);
+            destroy(n->right);
+            delete n;
+        }
+
+    public:
+        rank_tree() = default;
+        ~rank_tree() { destroy(_root); }
+
+        rank_tree(const rank_tree&) = delete;
+        rank_tree& operator=(const rank_tree&) = delete;
+        rank_tree(rank_tree&& src) noexcept : _root(std::exchange(src._root, nullptr)) {}
+        rank_tree& operator=(rank_tree&& src) noexcept {
+            std::swap(_root, src._root);
+            return *this;
+        }
+
+        // bucket of score, a new empty one when missing
+        node* emplace(const _Score& score) {
+            node* parent = nullptr;
+            node** link = &_root;
+            while (*link) {
+                parent = *link;
+                if (_Compare{}(score, parent->score)) {
+                    link = &parent->left;
+                } else if (_Compare{}(parent->score, score)) {
+                    link = &parent->right;
+                } else {
+                    return parent;
+                }
+            }
+            *link = new node{ score, {}, parent };
+            node* result = *link;
+            rebalance(parent);
+            return result;
+        }
+
+        void erase(node* z) {
+            node* from = z->parent;
+            if (!z->left || !z->right) {
+                replace(z, z->left ? z->left : z->right);
+            } else {
+                // the successor takes z's place
+                node* y = z->right;
+                while (y->left) y = y->left;
+                if (y->parent != z) {
+                    from = y->parent;
+                    replace(y, y->right);
+                    y->right = z->right;
+                    y->right->parent = y;
+                } else {
+                    from = y;
+                }
+                replace(z, y);
+                y->left = z->left;
+                y->left->parent = y;
+            }
+            delete z;
+            rebalance(from);
+        }
+
+        // n's bucket size changed
+        void resized(node* n) {
+            for (; n; n = n->parent) {
+                n->elements = n->bucket.size() + elements_of(n->left) + elements_of(n->right);
+            }
+        }
+
+        // elements in buckets ordered before n
+        size_t before(const node* n) const {
+            size_t result = elements_of(n->left);
+            for (; n->parent; n = n->parent) {
+                if (n == n->parent->right) {
+                    result += elements_of(n->parent->left) + n->parent->bucket.size();
+                }
+            }
+            return result;
+        }
+
+        // index-th bucket in score order, nullptr when out of range
+        node* at(size_t index) const {
+            node* n = _root;
+            while (n) {
+                const size_t left = buckets_of(n->left);
+                if (index < left) {
+                    n = n->left;
+                } else if (index == left) {
+                    return n;
+                } else {
+                    index -= left + 1;
+                    n = n->right;
+                }
+            }
+            return nullptr;
+        }
+
+        static node* next(node* n) {
+            if (n->right) {
+                n = n->right;
+                while (n->left) n = n->left;
+                return n;
+            }
+            while (n->parent && n == n->parent->right) n = n->parent;
+            return n->parent;
+        }
+
+        static node* prev(node* n) {
+            if (n->left) {
+                n = n->left;
+                while (n->right) n = n->right;
+                return n;
+            }
+            while (n->parent && n == n->parent->left) n = n->parent;
+            return n->parent;
+        }
+
+        size_t size() const { return elements_of(_root); }
+        size_t bucket_count() const { return buckets_of(_root); }
+
+        // every node in score order, the tree is left empty and the caller owns them
+        // a released node's `elements` is the element count before it (the old
+        // before()), the other aggregates are stale until build()
+        std::vector<node*> release() {
+            std::vector<node*> result;
+            result.reserve(bucket_count());
+            size_t sum = 0;
+            std::vector<node*> stack;  // explicit in-order walk, cheaper than next() chains
+            for (node* n = _root; n || !stack.empty(); n = n->right) {
+                for (; n; n = n->left) {
+                    stack.emplace_back(n);
+                }
+                n = stack.back();
+                stack.pop_back();
+                result.emplace_back(n);
+                n->elements = sum;
+                sum += n->bucket.size();
+            }
+            _root = nullptr;
+            return result;
+        }
+
+        // take ownership of nodes already in strictly ascending score order, O(n)
+        // the tree must be empty; the result is perfectly balanced
+        void build(const std::vector<node*>& sorted) {
+            destroy(_root);
+            _root = link(sorted, 0, sorted.size(), nullptr);
+        }
+
+    private:
+        static node* link(const std::vector<node*>& sorted, size_t first, size_t last, node* parent) {
+            if (first == last) {
+                return nullptr;
+            }
+            const size_t mid = first + (last - first) / 2;
+            node* n = sorted[mid];
+            n->parent = parent;
+            n->left = link(sorted, first, mid, n);
+            n->right = link(sorted, mid + 1, last, n);
+            update(n);
+            return n;
+        }
+    };
+
     template<
         class _Key, class _Value_key, class _Value_data,
         std::enable_if_t<is_std_hash_able_v<_Value_key>, bool> = true
@@ -24,13 +296,143 @@ namespace sort {
         using element_key = _Value_key;
         using element_value = _Value_data;
 
-        using sorted_map = std::map<score_type, std::unordered_map<element_key, element_value>>;
-        using elements_map = std::unordered_map<element_key, typename sorted_map::iterator>;
+        using sorted_tree = rank_tree<score_type, std::unordered_map<element_key, element_value>>;
+        using bucket_node = typename sorted_tree::node;
+        // merge must order buckets exactly like the tree does
+        using score_less = typename sorted_tree::compare_type;
+        using elements_map = std::unordered_map<element_key, bucket_node*>;
+
+    public:
+        struct update {
+            element_key key;
+            element_value value;
+            score_type score;
+        };
+
+        // rank (as rank()) of one updated element before and after a batch, -1 when it was new
+        struct rank_change {
+            element_key key;
+            int old_rank;
+            int new_rank;
+        };
 
     private:
-        sorted_map _sorted;
+        sorted_tree _sorted;
         elements_map _elements;
 
+    private:
+        // bucket index of a range bound, negative counts from the end (-1 is past the last)
+        int position(int index) const {
+            const int count = static_cast<int>(_sorted.bucket_count());
+            return index >= 0 ? index : std::max(count + index + 1, 0);
+        }
+
+        /*
+         * merge-vs-put cost model, fitted at -O2 on boards of 10k / 100k / 1M elements
+         * (0.63 buckets per element), unit: merge cost per bucket (~55ns at 10k, ~300ns
+         * at 1M, it grows with cache misses like everything else here)
+         * - put: a descent plus a walk back up, put_cost per tree level
+         * - rank(): one walk up, rank_cost per level, twice per key when reporting
+         * - merge: node_cost per bucket (release, merge walk, build) plus merged_cost
+         *   per update (sort, bucket insert)
+         * crossover on a 1M board: ~50k updates, ~26k when rank changes are reported
+         */
+        static constexpr double put_cost = 0.8;
+        static constexpr double rank_cost = 0.3;
+        static constexpr double node_cost = 1.0;
+        static constexpr double merged_cost = 5.0;
+
+        bool rebuild_cheaper(size_t updates, bool report) const {
+            double levels = 1;
+            for (size_t n = _sorted.bucket_count(); n > 1; n /= 2) {
+                ++levels;
+            }
+            const double per_put = levels * (put_cost + (report ? 2 * rank_cost : 0));
+            return updates * per_put > _sorted.bucket_count() * node_cost + updates * merged_cost;
+        }
+
+        // order: unique updates, result: same order as `order`, ranks are filled here
+        void merge(std::span<const update> updates, const std::vector<size_t>& order, std::vector<rank_change>* result) {
+            // aggregates are recomputed by build(), meanwhile `elements` is the old before()
+            const auto old_nodes = _sorted.release();
+
+            std::vector<bucket_node**> refs(order.size());  // element slots, stable across rehash
+            for (size_t j = 0; j < order.size(); ++j) {
+                auto [iter, inserted] = _elements.try_emplace(updates[order[j]].key, nullptr);
+                if (!inserted) {
+                    if (result) {
+                        (*result)[j].old_rank = static_cast<int>(iter->second->elements) + 1;
+                    }
+                    iter->second->bucket.erase(iter->first);
+                }
+                refs[j] = &iter->second;
+            }
+
+            std::vector<std::pair<score_type, size_t>> by_score;  // score, position in `order`
+            by_score.reserve(order.size());
+            for (size_t j = 0; j < order.size(); ++j) {
+                by_score.emplace_back(updates[order[j]].score, j);
+            }
+            std::sort(by_score.begin(), by_score.end(), [](const auto& a, const auto& b) {
+                return score_less{}(a.first, b.first);
+            });
+
+            // before[i]: elements in merged[0, i), known once merged[i] is pushed
+            // because only the back node still takes updates
+            std::vector<bucket_node*> merged;
+            std::vector<size_t> before;
+            merged.reserve(old_nodes.size() + order.size());
+            before.reserve(old_nodes.size() + order.size());
+            auto push = [&](bucket_node* n) {
+                before.emplace_back(merged.empty() ? 0 : before.back() + merged.back()->bucket.size());
+                merged.emplace_back(n);
+            };
+
+            std::vector<size_t> slot(order.size());  // merged index of every unique update
+            auto emit = [&](size_t j) {
+                const auto& one = updates[order[j]];
+                if (merged.empty() || score_less{}(merged.back()->score, one.score)) {
+                    push(new bucket_node{ one.score, {} });
+                }
+                merged.back()->bucket[one.key] = one.value;
+                *refs[j] = merged.back();
+                slot[j] = merged.size() - 1;
+            };
+
+            size_t next = 0;
+            for (auto n : old_nodes) {
+                for (; next < by_score.size() && score_less{}(by_score[next].first, n->score); ++next) {
+                    emit(by_score[next].second);
+                }
+                const bool joined = next < by_score.size() && !score_less{}(n->score, by_score[next].first);
+                if (n->bucket.empty() && !joined) {
+                    delete n;
+                    continue;
+                }
+                push(n);
+            }
+            for (; next < by_score.size(); ++next) {
+                emit(by_score[next].second);
+            }
+
+            if (result) {
+                for (size_t j = 0; j < result->size(); ++j) {
+                    (*result)[j].new_rank = static_cast<int>(before[slot[j]]) + 1;
+                }
+            }
+
+            _sorted.build(merged);
+        }
+
+        static void append(const bucket_node* n, std::vector<element_value>& result) {
+            std::transform(
+                n->bucket.begin(),
+                n->bucket.end(),
+                std::back_inserter(result),
+                [](auto& kv) { return kv.second; }
+            );
+        }
+
     public:
         sort() = default;
         ~sort() = default;
@@ -38,9 +440,10 @@ namespace sort {
         void put(const element_key& ele_key, const element_value& ele, const score_type& score) {
             rem(ele_key);
 
-            auto iter = _sorted.insert({ score, {} });
-            iter.first->second[ele_key] = ele;
-            _elements[ele_key] = iter.first;
+            auto node = _sorted.emplace(score);
+            node->bucket[ele_key] = ele;
+            _sorted.resized(node);
+            _elements[ele_key] = node;
         }
 
         void rem(const element_key& ele_key) {
@@ -48,90 +451,123 @@ namespace sort {
             if (iter == _elements.end()) {
                 return;
             }
-            // sorted_map's iterator->second.earse...
-            iter->second->second.erase(ele_key);
-            if (iter->second->second.empty()) {
-                _sorted.erase(iter->second);
+            auto node = iter->second;
+            node->bucket.erase(ele_key);
+            if (node->bucket.empty()) {
+                _sorted.erase(node);
+            } else {
+                _sorted.resized(node);
+            }
+            _elements.erase(iter);
+        }
+
+        /*
+         * put every update, the last one wins for a repeated key
+         * - a batch that is small against the board goes through put, a large one is
+         *   sorted by score and merged with the buckets in one pass, then the tree is
+         *   rebuilt balanced from the merged run: O(n + k log k) with no per update
+         *   descent or rebalancing, bucket nodes are reused so only new scores allocate
+         * - the switch point comes from the measured cost model above
+         * - report: returns the updated elements whose rank moved, in batch order
+         *   (old / new as rank(), -1 when new); elements that were only displaced by
+         *   the batch are not listed. without report nothing is returned and the put
+         *   path costs exactly the puts
+         */
+        std::vector<rank_change> apply_batch(std::span<const update> updates, bool report = true) {
+            std::vector<rank_change> result;
+            if (!report && !rebuild_cheaper(updates.size(), false)) {
+                for (const auto& one : updates) {
+                    put(one.key, one.value, one.score);
+                }
+                return result;
+            }
+
+            std::unordered_map<element_key, size_t> last;
+            last.reserve(updates.size());
+            std::vector<size_t> order;  // unique keys, first seen order, index of the last update
+            order.reserve(updates.size());
+            for (size_t i = 0; i < updates.size(); ++i) {
+                auto [it, inserted] = last.try_emplace(updates[i].key, order.size());
+                if (inserted) {
+                    order.emplace_back(i);
+                } else {
+                    order[it->second] = i;
+                }
             }
-            _elements.erase(ele_key);
+
+            if (report) {
+                result.reserve(order.size());
+                for (const auto i : order) {
+                    result.push_back({ updates[i].key, -1, -1 });
+                }
+            }
+
+            if (!rebuild_cheaper(order.size(), report)) {
+                for (auto& one : result) {
+                    one.old_rank = rank(one.key);
+                }
+                for (const auto i : order) {
+                    put(updates[i].key, updates[i].value, updates[i].score);
+                }
+                for (auto& one : result) {
+                    one.new_rank = rank(one.key);
+                }
+            } else {
+                merge(updates, order, report ? &result : nullptr);
+            }
+
+            std::erase_if(result, [](const rank_change& one) { return one.old_rank == one.new_rank; });
+            return result;
         }
 
+        // 1 + elements with a lower score, O(log n)
         int rank(const element_key& ele_key) {
             static constexpr int error_result = -1;
             const auto iter = _elements.find(ele_key);
             if (iter == _elements.end()) {
                 return error_result;
             }
-            int result = 0;
-            for (auto iter_sort = _sorted.begin(); iter_sort != iter->second; ++iter_sort) {
-                result += iter_sort->second.size();
-            }
-            return result + 1;
+            return static_cast<int>(_sorted.before(iter->second)) + 1;
         }
 
+        // elements with the same or a higher score, O(log n)
         int revrank(const element_key& ele_key) {
             static constexpr int error_result = -1;
             const auto iter = _elements.find(ele_key);
             if (iter == _elements.end()) {
                 return error_result;
             }
-            int result = 0;
-            for (auto iter_sort = iter->second; iter_sort != _sorted.end(); ++iter_sort) {
-                result += iter_sort->second.size();
-            }
-            return result;
+            return static_cast<int>(_sorted.size() - _sorted.before(iter->second));
         }
 
+        // buckets [start, stop] in ascending score order (redis style indexes)
+        // the first bucket is found in O(log n)
         std::vector<element_value> range(int start, int stop) {
-            auto iter_s = _sorted.end();
-            auto iter_e = _sorted.end();
-            if (start >= 0) {
-                iter_s = std::next(_sorted.begin(), start);
-            } else {
-                iter_s = std::next(_sorted.end(), start + 1);
-            }
-            if (stop >= 0) {
-                iter_e = std::next(_sorted.begin(), stop);
-            } else {
-                iter_e = std::next(_sorted.end(), stop + 1);
-            }
+            const int first = position(start);
+            const int last = position(stop);
 
             std::vector<element_value> result;
-            for (auto iter = iter_s; iter != _sorted.end(); ++iter) {
-                std::transform(
-                    iter->second.begin(),
-                    iter->second.end(),
-                    std::back_inserter(result),
-                    [](auto& kv) { return kv.second; }
-                );
-                if (iter == iter_e) break;
+            int index = first;
+            for (auto node = _sorted.at(first); node; node = sorted_tree::next(node), ++index) {
+                append(node, result);
+                if (index == last) break;
             }
             return result;
         }
 
         std::vector<element_value> revrange(int start, int stop) {
-            auto iter_s = _sorted.rbegin();
-            auto iter_e = _sorted.rbegin();
-            if (start >= 0) {
-                iter_s = std::next(_sorted.rbegin(), start);
-            } else {
-                iter_s = std::next(_sorted.rend(), start + 1);
-            }
-            if (stop >= 0) {
-                iter_e = std::next(_sorted.rbegin(), stop);
-            } else {
-                iter_e = std::next(_sorted.rend(), stop + 1);
-            }
+            const int first = position(start);
+            const int last = position(stop);
+            const int count = static_cast<int>(_sorted.bucket_count());
 
             std::vector<element_value> result;
-            for (auto iter = iter_s; iter != _sorted.rend(); ++iter) {
-                std::transform(
-                    iter->second.begin(),
-                    iter->second.end(),
-                    std::back_inserter(result),
-                    [](auto& kv) { return kv.second; }
-                );
-                if (iter == iter_e) break;
+            if (first >= count) {
+                return result;
+            }
+            int index = first;
+            for (auto node = _sorted.at(count - 1 - first); node; node = sorted_tree::prev(node), ++index) {
+                append(node, result);
+                if (index == last) break;
             }
             return result;
         }
@@ -192,6 +628,13 @@ auto revrange_res = _sort_1.revrange(0, -1);
 auto range_res2 = _sort_1.range(0, 5);
 auto revrange_res2 = _sort_1.revrange(0, 5);
 
+// settlement: one burst, only the moved elements come back
+std::vector<decltype(_sort_1)::update> updates{
+    { 1, { 1, "_1" }, { 10, 0 } },
+    { 2, { 2, "_2" }, { 0, 0 } },
+};
+auto changes = _sort_1.apply_batch(updates);  // {1, 1, 9}, {2, 2, 1}
+
 // break-point
 int i = 0;
 i += 1;
@@ -1,10 +1,16 @@
 #pragma once
 #include <array>
+#include <cstdint>
+#include <list>
 #include <map>
 #include <optional>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
+#include "fenwick_tree.hpp"
 
 namespace util {
 
@@ -24,6 +30,14 @@ static auto splitter(score_tt source) -> std::decay_t<score_tt> {
  *
  */
 
+/*
+ * - asc[splitter(score)] is a score -> elements map, e2is locates an element
+ * - counts is a fenwick tree of element counts per splitter bucket:
+ *   elements in lower buckets are one prefix sum, the n-th element's bucket
+ *   is one fenwick descent
+ * - inside the bucket the score map is still walked, splitter keeps buckets
+ *   narrow so that walk is short
+ */
 template <uint16_t level_vv, class score_tt, class element_key_tt,
           class element_tt>
 class container {
@@ -34,9 +48,7 @@ class container {
   using elements = std::unordered_map<element_key_type, element_type>;
   using score_elements = std::map<score_type, elements>;
 
-  using sort_container = std::map<score_type, score_elements>;
   using array_sort_container = std::array<score_elements, level_vv>;
-  using element2score = std::unordered_map<element_key_type, score_type>;
   using element2iterator = std::unordered_map<
       element_key_type,
       std::tuple<std::size_t, typename score_elements::iterator,
@@ -46,11 +58,9 @@ class container {
   static constexpr rank_type not_exist_rank = 0;
 
  private:
-  sort_container sc;
-  element2score es;
-
   array_sort_container asc;
   element2iterator e2is;
+  fenwick_tree<rank_type> counts{level_vv};
 
  public:
   explicit container() = default;
@@ -72,15 +82,11 @@ class container {
       return false;
     }
     auto& asc_data = asc.at(ks);
-    const auto ele = elements::value_type(ek, std::forward<element_type>(e));
-    auto [se_it_fst, se_it_snd] = asc_data.emplace(k, elements{ele});
-    if (!se_it_snd) {
-      auto [e_it_fst, e_it_snd] = se_it_fst->second.emplace(ele);
-      return e2is.emplace(ek, std::make_tuple(ks, se_it_fst, e_it_fst)).second;
-    }
-    return e2is
-        .emplace(ek, std::make_tuple(ks, se_it_fst, se_it_fst->second.begin()))
-        .second;
+    auto [se_it, se_new] = asc_data.try_emplace(k);
+    auto [e_it, e_new] =
+        se_it->second.emplace(ek, std::forward<element_type>(e));
+    counts.add(ks, 1);
+    return e2is.emplace(ek, std::make_tuple(ks, se_it, e_it)).second;
   }
 
   [[maybe_unused]] bool erase(const element_key_type& ek) {
@@ -88,111 +94,74 @@ class container {
       auto [index, se_it, e_it] = e2is_it->second;
 
       se_it->second.erase(e_it);
+      if (se_it->second.empty()) {
+        asc.at(index).erase(se_it);
+      }
       e2is.erase(e2is_it);
+      counts.add(index, rank_type(-1));
 
       return true;
     }
     return false;
   }
 
-  [[nodiscard]] std::size_t size() const { return es.size(); }
+  [[nodiscard]] std::size_t size() const { return e2is.size(); }
 
+  // 1 + elements with a lower score
   [[nodiscard]] rank_type rank(const element_key_type& ek) const {
     if (const auto& e2is_it = e2is.find(ek); e2is_it != e2is.end()) {
       auto [index, se_it, e_it] = e2is_it->second;
 
-      rank_type result = 1;
-
-      for (std::size_t i = 0; i <= index; ++i) {
-        if (i == index) {
-          for (auto each_se_it = asc.at(i).cbegin(); each_se_it != se_it;
-               ++each_se_it) {
-            result += each_se_it->second.size();
-          }
-          return result;
-        }
-        for (auto each_se_it = asc.at(i).cbegin();
-             each_se_it != asc.at(i).cend(); ++each_se_it) {
-          result += each_se_it->second.size();
-        }
+      rank_type result = 1 + counts.prefix(index);
+      for (auto each_se_it = asc.at(index).cbegin(); each_se_it != se_it;
+           ++each_se_it) {
+        result += each_se_it->second.size();
       }
       return result;
     }
     return not_exist_rank;
-
-    if (const auto& ec_it = es.find(ek); ec_it != es.end()) {
-      return inner_rank(ec_it->second);
-    }
-    return not_exist_rank;
   }
 
   [[nodiscard]] std::optional<score_type> score(
       const element_key_type& ek) const {
-    if (const auto& ec_it = es.find(ek); ec_it != es.end()) {
-      return ec_it->second;
+    if (const auto& e2is_it = e2is.find(ek); e2is_it != e2is.end()) {
+      return std::get<1>(e2is_it->second)->first;
     }
     return std::nullopt;
   }
 
+  // positions [l, r] (1-based, inclusive) in ascending score order
   std::vector<element_key_type> range(rank_type l, rank_type r) const {
     std::vector<element_key_type> result{};
-
+    if (l == 0)
+      l = 1;
+    if (r > size())
+      r = size();
     if (r < l) {
       return result;
     }
 
-    rank_type diff = r - l;
-
-    auto begin = sc.cbegin();
-    auto end = sc.cend();
-
-    auto it = begin;
-
-    while (it != end && it->second.size() < l) {
-      ++it;
-    }
-
-    if (it == end)
-      return result;
-
-    rank_type count = 0;
-    while (it != end) {
-      for (const auto& it_ele_sc : it->second) {
-        result.emplace_back(it_ele_sc.second.cbegin(), it_ele_sc.second.cend());
-        if (++count >= diff) {
-          return result;
-        }
-      }
-      ++it;
-    }
-    return result;
-  }
-
- private:
-  rank_type inner_rank(const score_type& k) const {
-    return inner_rank(splitter<score_type>(k), k);
-  }
-
-  rank_type inner_rank(const score_type& ks, const score_type& k) const {
-    rank_type result = 1;
-    if (const auto& sc_first_it = sc.find(ks); sc_first_it != sc.end()) {
-      for (auto it = sc.cbegin(); it != sc_first_it; ++it) {
-        for (auto sub_it = it->second.cbegin(); sub_it != it->second.cend();
-             ++sub_it) {
-          result += sub_it->second.size();
+    result.reserve(r - l + 1);
+    rank_type skip = l - 1;
+    for (auto index = counts.lower_bound(skip); index < level_vv; ++index) {
+      for (const auto& [k, es] : asc[index]) {
+        if (skip >= es.size()) {
+          skip -= es.size();
+          continue;
         }
-      }
-
-      if (const auto& sc_second_it = sc_first_it->second.find(k);
-          sc_second_it != sc_first_it->second.end()) {
-        for (auto sub_it = sc_first_it->second.cbegin(); sub_it != sc_second_it;
-             ++sub_it) {
-          result += sub_it->second.size();
+        for (const auto& [ek, e] : es) {
+          if (skip > 0) {
+            --skip;
+            continue;
+          }
+          result.emplace_back(ek);
+          if (result.size() > r - l) {
+            return result;
+          }
         }
-        return result;
       }
     }
-    return not_exist_rank;
+    return result;
   }
 };
 
@@ -204,9 +173,7 @@ class container2 {
   using elements = std::list<element_key_type>;
   using score_elements = std::map<score_type, elements>;
 
-  using sort_container = std::map<score_type, score_elements>;
   using array_sort_container = std::array<score_elements, level_vv>;
-  using element2score = std::unordered_map<element_key_type, score_type>;
   using element2iterator = std::unordered_map<
       element_key_type,
       std::tuple<std::size_t, typename score_elements::iterator,
@@ -216,11 +183,9 @@ class container2 {
   static constexpr rank_type not_exist_rank = 0;
 
  private:
-  sort_container sc;
-  element2score es;
-
   array_sort_container asc;
   element2iterator e2is;
+  fenwick_tree<rank_type> counts{level_vv};
 
  public:
   explicit container2() = default;
@@ -246,6 +211,7 @@ class container2 {
     if (!se_it_snd) {
       se_it_fst->second.emplace_front(ek);
     }
+    counts.add(ks, 1);
     return e2is
         .emplace(ek, std::make_tuple(ks, se_it_fst, se_it_fst->second.begin()))
         .second;
@@ -256,33 +222,28 @@ class container2 {
       auto [index, se_it, e_it] = e2is_it->second;
 
       se_it->second.erase(e_it);
+      if (se_it->second.empty()) {
+        asc.at(index).erase(se_it);
+      }
       e2is.erase(e2is_it);
+      counts.add(index, rank_type(-1));
 
       return true;
     }
     return false;
   }
 
-  [[nodiscard]] std::size_t size() const { return es.size(); }
+  [[nodiscard]] std::size_t size() const { return e2is.size(); }
 
+  // 1 + elements with a lower score
   [[nodiscard]] rank_type rank(const element_key_type& ek) const {
     if (const auto& e2is_it = e2is.find(ek); e2is_it != e2is.end()) {
       auto [index, se_it, e_it] = e2is_it->second;
 
-      rank_type result = 1;
-
-      for (std::size_t i = 0; i <= index; ++i) {
-        if (i == index) {
-          for (auto each_se_it = asc.at(i).cbegin(); each_se_it != se_it;
-               ++each_se_it) {
-            result += each_se_it->second.size();
-          }
-          return result;
-        }
-        for (auto each_se_it = asc.at(i).cbegin();
-             each_se_it != asc.at(i).cend(); ++each_se_it) {
-          result += each_se_it->second.size();
-        }
+      rank_type result = 1 + counts.prefix(index);
+      for (auto each_se_it = asc.at(index).cbegin(); each_se_it != se_it;
+           ++each_se_it) {
+        result += each_se_it->second.size();
       }
       return result;
     }
@@ -291,71 +252,44 @@ class container2 {
 
   [[nodiscard]] std::optional<score_type> score(
       const element_key_type& ek) const {
-    if (const auto& ec_it = es.find(ek); ec_it != es.end()) {
-      return ec_it->second;
+    if (const auto& e2is_it = e2is.find(ek); e2is_it != e2is.end()) {
+      return std::get<1>(e2is_it->second)->first;
     }
     return std::nullopt;
   }
 
+  // positions [l, r] (1-based, inclusive) in ascending score order
   std::vector<element_key_type> range(rank_type l, rank_type r) const {
     std::vector<element_key_type> result{};
-
+    if (l == 0)
+      l = 1;
+    if (r > size())
+      r = size();
     if (r < l) {
       return result;
     }
 
-    rank_type diff = r - l;
-
-    auto begin = sc.cbegin();
-    auto end = sc.cend();
-
-    auto it = begin;
-
-    while (it != end && it->second.size() < l) {
-      ++it;
-    }
-
-    if (it == end)
-      return result;
-
-    rank_type count = 0;
-    while (it != end) {
-      for (const auto& it_ele_sc : it->second) {
-        result.emplace_back(it_ele_sc.second.cbegin(), it_ele_sc.second.cend());
-        if (++count >= diff) {
-          return result;
+    result.reserve(r - l + 1);
+    rank_type skip = l - 1;
+    for (auto index = counts.lower_bound(skip); index < level_vv; ++index) {
+      for (const auto& [k, es] : asc[index]) {
+        if (skip >= es.size()) {
+          skip -= es.size();
+          continue;
         }
-      }
-      ++it;
-    }
-    return result;
-  }
-
- private:
-  rank_type inner_rank(const score_type& k) const {
-    return inner_rank(splitter<score_type>(k), k);
-  }
-
-  rank_type inner_rank(const score_type& ks, const score_type& k) const {
-    rank_type result = 1;
-    if (const auto& sc_first_it = sc.find(ks); sc_first_it != sc.end()) {
-      for (auto it = sc.cbegin(); it != sc_first_it; ++it) {
-        for (auto sub_it = it->second.cbegin(); sub_it != it->second.cend();
-             ++sub_it) {
-          result += sub_it->second.size();
-        }
-      }
-
-      if (const auto& sc_second_it = sc_first_it->second.find(k);
-          sc_second_it != sc_first_it->second.end()) {
-        for (auto sub_it = sc_first_it->second.cbegin(); sub_it != sc_second_it;
-             ++sub_it) {
-          result += sub_it->second.size();
+        for (const auto& ek : es) {
+          if (skip > 0) {
+            --skip;
+            continue;
+          }
+          result.emplace_back(ek);
+          if (result.size() > r - l) {
+            return result;
+          }
         }
-        return result;
       }
     }
-    return not_exist_rank;
+    return result;
   }
 };
 }  // namespace splitter_sorter
@@ -1,7 +1,9 @@
 #pragma once
 #include <algorithm>
+#include <cstring>
 #include <functional>
 #include <string>
+#include <string_view>
 
 namespace easy {
 namespace utils {
@@ -400,5 +402,26 @@ std::vector<string_tt> split(const string_tt &str,
            (max_field == 0 || ++count_field < max_field));
   return result;
 }
+
+// transparent hash for std::string keyed unordered containers
+// find(std::string_view / const char*) without building a std::string
+// pair with std::equal_to<>
+struct string_hash {
+  using is_transparent = void;
+
+  std::size_t operator()(std::string_view sv) const {
+    return std::hash<std::string_view>{}(sv);
+  }
+};
+
+#ifdef __cpp_concepts
+// both hash and equal declare is_transparent (same rule as std::unordered_map)
+// the caches enable heterogeneous get / rem with it
+template <class hash_tt, class key_equal_tt>
+concept transparent_key = requires {
+  typename hash_tt::is_transparent;
+  typename key_equal_tt::is_transparent;
+};
+#endif
 } // namespace utils
 } // namespace easy
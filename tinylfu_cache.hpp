@@ -0,0 +1,210 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+#include "lfu_cache.hpp"
+
+namespace easy::tinylfu {
+
+/*
+ * W-TinyLFU https://arxiv.org/abs/1512.00727
+ *
+ * |-- window lru (1%) --|------------- main slru (99%) -------------|
+ *                       |-- probation (20%) --|-- protected (80%) --|
+ *
+ * - every access is recorded in a count-min sketch (lfu::frequency_sketch),
+ *   the sketch halves itself periodically so old popularity fades
+ * - new keys enter the window, the window tail is a candidate for main
+ * - the candidate is admitted only when the sketch says it is hotter than the
+ *   main victim (probation tail), otherwise the candidate is dropped. one-off
+ *   scans stay in the small window and never flush the hot set
+ * - a probation hit is promoted to protected, protected overflow is demoted
+ *   back to probation
+ * - not thread safe, same as lfu::cache
+ */
+template <class key_tt, class value_tt, size_t max_size,
+          class hash_tt = std::hash<key_tt>,
+          class key_equal_tt = std::equal_to<key_tt>>
+class cache {
+ public:
+  enum class segment : uint8_t { window, probation, protect };
+
+  struct node {
+    key_tt key;
+    value_tt value;
+    segment where = segment::window;
+  };
+
+  using remove_callback = std::function<void(key_tt&& key, value_tt&& value)>;
+  using node_list = std::list<node>;
+  using node_map = std::unordered_map<key_tt, typename node_list::iterator,
+                                      hash_tt, key_equal_tt>;
+
+  static constexpr size_t window_size =
+      max_size / 100 > 0 ? max_size / 100 : 1;
+  static constexpr size_t main_size =
+      max_size > window_size ? max_size - window_size : 0;
+  static constexpr size_t protect_size = main_size * 8 / 10;
+
+ private:
+  node_list _window;
+  node_list _probation;
+  node_list _protect;
+  node_map _key2node;
+
+  lfu::frequency_sketch _sketch{max_size};
+
+  remove_callback _on_remove;
+
+ private:
+  node_list& list_of(segment where) {
+    switch (where) {
+      case segment::window:
+        return _window;
+      case segment::probation:
+        return _probation;
+      default:
+        return _protect;
+    }
+  }
+
+  void move_front(typename node_list::iterator it, segment where) {
+    auto& from = list_of(it->where);
+    auto& to = list_of(where);
+    to.splice(to.begin(), from, it);
+    it->where = where;
+  }
+
+  void evict(node_list& from, typename node_list::iterator it) {
+    auto one = std::move(*it);
+    _key2node.erase(one.key);
+    from.erase(it);
+
+    if (_on_remove) {
+      _on_remove(std::move(one.key), std::move(one.value));
+    }
+  }
+
+  void on_hit(typename node_list::iterator it) {
+    switch (it->where) {
+      case segment::window:
+        move_front(it, segment::window);
+        break;
+      case segment::probation:
+        move_front(it, segment::protect);
+        if (_protect.size() > protect_size) {
+          move_front(std::prev(_protect.end()), segment::probation);
+        }
+        break;
+      case segment::protect:
+        move_front(it, segment::protect);
+        break;
+    }
+  }
+
+  // window overflow: the window tail either joins main or is dropped
+  void admit() {
+    if (_window.size() <= window_size)
+      return;
+
+    auto candidate = std::prev(_window.end());
+    if (_probation.size() + _protect.size() < main_size) {
+      move_front(candidate, segment::probation);
+      return;
+    }
+
+    auto& victim_list = _probation.empty() ? _protect : _probation;
+    if (victim_list.empty()) {
+      evict(_window, candidate);
+      return;
+    }
+
+    auto victim = std::prev(victim_list.end());
+    if (_sketch.estimate(hash_tt{}(candidate->key)) >
+        _sketch.estimate(hash_tt{}(victim->key))) {
+      evict(victim_list, victim);
+      move_front(candidate, segment::probation);
+    } else {
+      evict(_window, candidate);
+    }
+  }
+
+  template <class lookup_tt>
+  value_tt* do_get(const lookup_tt& key) {
+    _sketch.increment(hash_tt{}(key));
+    const auto iter = _key2node.find(key);
+    if (iter == _key2node.end())
+      return nullptr;
+
+    on_hit(iter->second);
+    return &(iter->second->value);
+  }
+
+ public:
+  explicit cache(remove_callback&& on_remove = nullptr)
+      : _on_remove(std::move(on_remove)) {}
+
+  // non-copyable
+  cache(const cache&) = delete;
+  cache(cache&&) = delete;
+  cache& operator=(const cache&) = delete;
+
+  bool put(const key_tt& key, const value_tt& value) {
+    if (max_size == 0)
+      return false;
+
+    _sketch.increment(hash_tt{}(key));
+    if (const auto iter = _key2node.find(key); iter != _key2node.end()) {
+      iter->second->value = value;
+      on_hit(iter->second);
+      return true;
+    }
+
+    _window.emplace_front(node{key, value, segment::window});
+    _key2node.emplace(key, _window.begin());
+    admit();
+    return true;
+  }
+
+  value_tt* get(const key_tt& key) { return do_get(key); }
+
+  // heterogeneous lookup, e.g. std::string_view on std::string keys
+  template <class lookup_tt>
+    requires utils::transparent_key<hash_tt, key_equal_tt>
+  value_tt* get(const lookup_tt& key) {
+    return do_get(key);
+  }
+
+  void rem(const key_tt& key) {
+    const auto iter = _key2node.find(key);
+    if (iter == _key2node.end())
+      return;
+    evict(list_of(iter->second->where), iter->second);
+  }
+
+  [[nodiscard]] size_t size() const { return _key2node.size(); }
+};
+
+};  // namespace easy::tinylfu
+
+/* hit ratio: hot set of 1k keys mixed with one-off scans
+
+easy::lru::cache<uint64_t, uint64_t, 2000> lru;
+easy::tinylfu::cache<uint64_t, uint64_t, 2000> tlfu;
+
+uint32_t seed = lcg_seed(12345);
+uint64_t scan = 1000000;
+size_t lru_hit = 0, tlfu_hit = 0, total = 0;
+for (int i = 0; i < 2000000; ++i) {
+  uint64_t key = (i % 3 == 0) ? ++scan : lcg_rand(seed) % 1000;
+  ++total;
+  if (lru.get(key)) ++lru_hit; else lru.add(key, key);
+  if (tlfu.get(key)) ++tlfu_hit; else tlfu.put(key, key);
+}
+std::cout << "lru: " << lru_hit * 1.0 / total
+          << " tinylfu: " << tlfu_hit * 1.0 / total << std::endl;
+
+*/
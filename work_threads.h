@@ -1,20 +1,26 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdexcept>
 #include <thread>
 #include <mutex>
 #include <future>
 #include <condition_variable>
 #include <queue>
+#include <vector>
 
 namespace inlay::base {
     class work_threads final {
 
         struct worker final {
-            std::thread _thread;
             std::queue<std::function<void()>> _tasks;
             std::mutex _queue_mutex;
             std::condition_variable _condition;
-            std::atomic_bool _stop;
+            std::atomic_bool _stop{ false };
+            // declared last: the thread starts in the ctor and uses every member above
+            std::thread _thread;
 
             worker()
                 : _thread([this] {
@@ -32,8 +38,7 @@ namespace inlay::base {
 
                         task();
                     }
-                })
-                , _stop(false) {
+                }) {
             }
 
             ~worker() {